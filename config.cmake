@@ -5,4 +5,8 @@
 #cmakedefine ORDPATH_SSE2_BITBUF
 #cmakedefine ORDPATH_ALT_SSE2_BITBUF
 #cmakedefine ORDPATH_SSE2_SEARCHTREE
+#cmakedefine ORDPATH_SSE2_FILTER
 
+#cmakedefine ORDPATH_SSE42_CRC32C
+#cmakedefine ORDPATH_WIDE_DECODER
+#cmakedefine ORDPATH_PREFIXSUM_ENCODER
@@ -38,9 +38,11 @@
 #include <string.h>
 #include <stdlib.h>
 #include <limits.h>
+#include <pthread.h>
+#include <unistd.h>
 
 #if defined(ORDPATH_SSE2_BITBUF) || defined(ORDPATH_ALT_SSE2_BITBUF) \
-    || defined(ORDPATH_SSE2_SEARCHTREE)
+    || defined(ORDPATH_SSE2_SEARCHTREE) || defined(ORDPATH_SSE2_FILTER)
 #include <emmintrin.h>
 
 #define _ex_byteswapl_epi64(x)                                  \
@@ -56,6 +58,10 @@
 
 #endif
 
+#if defined(ORDPATH_SSE42_CRC32C)
+#include <nmmintrin.h>
+#endif
+
 #include "ordpath.h"
 
 /********************************************************************
@@ -156,6 +162,18 @@ const char * const ordpath_compile_options = 2 +
 #endif
 #if defined(ORDPATH_SSE2_SEARCHTREE)
     ", sse2-search-tree"
+#endif
+#if defined(ORDPATH_SSE2_FILTER)
+    ", sse2-filter"
+#endif
+#if defined(ORDPATH_SSE42_CRC32C)
+    ", sse42-crc32c"
+#endif
+#if defined(ORDPATH_WIDE_DECODER)
+    ", wide-decoder"
+#endif
+#if defined(ORDPATH_PREFIXSUM_ENCODER)
+    ", prefixsum-encoder"
 #endif
     "\0\0(none)";
 
@@ -181,11 +199,14 @@ ordpath_strerror(
     STRERROR_ITEM (ORDPATH_INTERNALERROR, "Internal error")
     STRERROR_ITEM (ORDPATH_OUTOFMEM,      "Out of memory")
     STRERROR_ITEM (ORDPATH_INVAL,         "Invalid parameter")
+    STRERROR_ITEM (ORDPATH_BUFTOOSMALL,   "Output buffer too small")
     STRERROR_ITEM (ORDPATH_SETUPPARSE,    "Unable to parse setup")
     STRERROR_ITEM (ORDPATH_SETUPINVAL,    "Invalid setup")
     STRERROR_ITEM (
             ORDPATH_SETUPLIMIT, "Setup rejected due to internal limits")
     STRERROR_ITEM (ORDPATH_CORRUPTDATA,   "Data corruption detected")
+    STRERROR_ITEM (
+            ORDPATH_OUTOFRANGE, "Component is outside the codec range")
     }
 
     snprintf(buf, bufsize, "%s", m);
@@ -201,6 +222,8 @@ struct setup {
         int             prefixlen;
         int             width;
     }                   intervals [INTERVAL_NUM_MAX];
+    int                 termprefix;
+    int                 termprefixlen; /* 0 - no terminator */
 };
 
 static status_t parse_setup(
@@ -223,7 +246,28 @@ static status_t parse_setup(
 
     memset(setup, 0, sizeof *setup);
     while (setupstr[strpos]) {
-        int n;
+        int n = -1;
+
+        /* end-of-label code: "<prefix> : end" */
+        if (sscanf(setupstr + strpos,
+                " %"STR(PREFIX_LEN_PARSE_MAX)"[01] : end %n",
+                prefixstr, &n) >= 1 && n >= 0) {
+            strpos += n;
+            prefixlen = strlen(prefixstr);
+            if (prefixlen > PREFIX_LEN_MAX) {
+                DEBUG("Prefix length exceeds %d bit(s)", PREFIX_LEN_MAX);
+                status = ORDPATH_SETUPLIMIT;
+                goto out;
+            }
+            if (setup->termprefixlen) {
+                DEBUG("Terminator already set");
+                status = ORDPATH_SETUPINVAL;
+                goto out;
+            }
+            setup->termprefix = strtol(prefixstr, NULL, 2);
+            setup->termprefixlen = prefixlen;
+            continue;
+        }
 
         if (curinterval >= INTERVAL_NUM_MAX) {
             DEBUG("The number of intervals exceeds %d", INTERVAL_NUM_MAX);
@@ -338,6 +382,20 @@ struct ordpath_codec {
 #error adjust ordpath_codec.intlookuptab size
 #endif
 
+    /* encoded labels compare (bitwise) in the same order as labels */
+    int                        ordered;
+
+    /* values the codec can encode, [range[0], range[1]) */
+    int64_t                    range [2];
+
+    /* the shortest encoded component */
+    int                        minbitlen;
+
+    /* end-of-label code (see ordpath_encode_delimited()), termlen is 0
+     * if the setup defines none */
+    int                        termcode;
+    int                        termlen;
+
     void                      *mem;
 };
 
@@ -432,6 +490,8 @@ ordpath_create(
             & ~(uintptr_t)(CODEC_ALIGNMENT - 1));
     memset(codec, 0, sizeof *codec);
     codec->mem = mem;
+    codec->range[0] = intervalmin[0];
+    codec->range[1] = intervalmin[n];
 
 #ifdef BOUNDS_HEAP_PRESENT
     /*
@@ -453,11 +513,13 @@ ordpath_create(
      * setup codec->intervals
      */
     codec->intervals[0].bitlen = 10000;
+    codec->minbitlen = 10000;
     for (i=0; i<n; i++) {
         struct intervalsetup *is = setup.intervals + i;
         struct interval *in = codec->intervals + is->index;
         in->bias = ((int64_t)is->prefix << is->width) - intervalmin[i];
         in->bitlen = is->prefixlen + is->width;
+        codec->minbitlen = MIN(codec->minbitlen, in->bitlen);
     }
 
     /*
@@ -479,6 +541,40 @@ ordpath_create(
         }
     }
 
+    /*
+     * the terminator's slots stay 0, the regular decoder treats it as
+     * corrupt data
+     */
+    if (setup.termprefixlen) {
+        int freebits, ltind, ltend;
+        freebits = PREFIX_LEN_MAX - setup.termprefixlen;
+        ltind = setup.termprefix << freebits;
+        ltend = ltind + (1 << freebits);
+        while (ltind < ltend) {
+            if (codec->intlookuptab[ltind++] != 0) {
+                DEBUG("Encoding is not prefix-free");
+                status = ORDPATH_SETUPINVAL;
+                goto out;
+            }
+        }
+        codec->termcode = setup.termprefix;
+        codec->termlen = setup.termprefixlen;
+    }
+
+    /*
+     * setup codec->ordered: intervals are listed in ascending order,
+     * encoding preserves order iff prefixes are ascending as well
+     */
+    codec->ordered = 1;
+    for (i=1; i<n; i++) {
+        struct intervalsetup *prev = setup.intervals + i - 1;
+        struct intervalsetup *is = setup.intervals + i;
+        if ((prev->prefix << (PREFIX_LEN_MAX - prev->prefixlen))
+                >= (is->prefix << (PREFIX_LEN_MAX - is->prefixlen))) {
+            codec->ordered = 0;
+        }
+    }
+
 out:
     if (status != ORDPATH_SUCCESS) {
         ordpath_destroy(codec);
@@ -497,76 +593,212 @@ ordpath_destroy(
     }
 }
 
-status_t
-ordpath_encode(
+/*
+ * Load 64 bits from an arbitrary address, big endian byteorder.
+ */
+static inline uint64_t load_be64(const char *p)
+{
+    uint64_t w;
+    memcpy(&w, p, sizeof w);
+#if (__BYTE_ORDER == __LITTLE_ENDIAN)
+    w = __builtin_bswap64(w);
+#endif
+    return w;
+}
+
+/*
+ * Unaligned access to 64 bit words (big endian byteorder). A word is
+ * moved through a temporary, that works for every bitbuf flavour. Only
+ * the first *size* bytes are accessed.
+ */
+static inline bitbuf_t bb_loadu_be(const char *ptr, size_t size)
+{
+    int64_t t = 0;
+    memcpy(&t, ptr, size);
+    return bb_load_be(&t);
+}
+
+static inline void bb_storeu_be(char *ptr, bitbuf_t x, size_t size)
+{
+    int64_t t;
+    bb_store_be(&t, x);
+    memcpy(ptr, &t, size);
+}
+
+/*
+ * Find the interval enclosing the component.
+ */
+static inline int lookup_interval(
+    const codec_t *restrict codec,
+    const int64_t *restrict pv)
+{
+    int intind;
+
+#ifdef BOUNDS_HEAP_PRESENT
+    /*
+     * lookup component in interval heap
+     */
+    int64_t v = *pv;
+    int heapind = 1;
+    int n = codec->intboundsnum;
+    while (__LIKELY(heapind <= n)) {
+        heapind = heapind*2 + (int)(v >= codec->intboundsheap[heapind]);
+    }
+    intind = heapind - n;
+#endif
+
+#ifdef ORDPATH_SSE2_SEARCHTREE
+    /*
+     * lookup component in interval search tree
+     */
+    __m128i v, deltalo, deltahi, pkdelta, m;
+    const __m128i *p;
+    int indlo, indhi;
+
+    v = _mm_shuffle_epi32(
+                    _mm_loadl_epi64((const __m128i *)pv),
+                    _MM_SHUFFLE(1, 0, 1, 0));
+
+    p = codec->intbounds5tree;
+    deltalo = _mm_sub_epi64(v, p[0]);
+    deltahi = _mm_sub_epi64(v, p[1]);
+    pkdelta = _mm_packs_epi32(deltalo, deltahi);
+    m = _mm_srai_epi32(pkdelta, 31);
+    indhi = __builtin_ctz(~_mm_movemask_epi8(m));
+
+    p = (const void *)((uintptr_t)p + 32 + indhi*8);
+    deltalo = _mm_sub_epi64(v, p[0]);
+    deltahi = _mm_sub_epi64(v, p[1]);
+    pkdelta = _mm_packs_epi32(deltalo, deltahi);
+    m = _mm_srai_epi32(pkdelta, 31);
+    indlo = __builtin_ctz(~_mm_movemask_epi8(m));
+
+    intind = (indhi*5 + indlo + 4) >> 2;
+#endif
+
+    return intind;
+}
+
+/*
+ * Encoder. Output starts at *bitoff* bit of outbuf[0] (bitoff < 8),
+ * leading bits are preserved. In unaligned mode the output is written
+ * with unaligned stores and the last partial word is written bytewise,
+ * nothing is written past the label end. In exact mode (implies
+ * unaligned) output capacity (outsize bytes) is checked as well; it is
+ * only necessary when data is flushed to memory. The remaining bits of
+ * the last byte are zeroed unless *keeptail* is set (unaligned mode
+ * only).
+ *
+ * With ORDPATH_PREFIXSUM_ENCODER components are first processed in
+ * blocks of ENCODE_BLOCK: codes and bit lengths are computed for the
+ * whole block, an exclusive prefix sum of bit lengths yields every
+ * code's output offset, codes are ORed into a register pair (or a
+ * small array of words if the block exceeds 128 bits) and
+ * full words are flushed. There is no serial dependency through
+ * *accused* and no flush branch within a block. The rest of the label
+ * is handled by the regular loop.
+ */
+
+#define ENCODE_BLOCK           8
+
+static inline status_t encode_core(
     const codec_t *restrict codec,
     const int64_t *restrict label,
     size_t lablen,
     char *restrict outbuf,
-    size_t *restrict poutbitlen)
+    int bitoff,
+    size_t outsize,
+    size_t *restrict poutbitlen,
+    const int unaligned,
+    const int exact,
+    const int keeptail)
 {
     const int64_t *endlabel = label + lablen;
-    int64_t *out = (int64_t *)outbuf;
+    char *out = outbuf;
     bitbuf_t acc;
-    int accused = 0;
+    int accused = bitoff;
 
-#ifndef NDEBUG
-    /*
-     * rejecting unaligned buffer
-     */
-    if ((uintptr_t)outbuf & (ORDPATH_BUF_ALIGNMENT - 1)) {
-        DEBUG("Unaligned buffer, expected alignment %d",
-            ORDPATH_BUF_ALIGNMENT);
-        return ORDPATH_INVAL;
+    acc = bb_zero();
+    if (bitoff) {
+        /* keep leading bits */
+        int64_t t = 0;
+        *(unsigned char *)&t = (unsigned char)outbuf[0]
+            & (0xff << (CHAR_BIT - bitoff));
+        acc = bb_load_be(&t);
     }
-#endif
 
-    acc = bb_zero();
-    while (label < endlabel) {
-        bitbuf_t c;
-        int intind, bitlen;
+#if defined(ORDPATH_PREFIXSUM_ENCODER)
+    while (endlabel - label >= ENCODE_BLOCK) {
+        int64_t words [ENCODE_BLOCK + 2];
+        uint64_t codes [ENCODE_BLOCK];
+        int offs [ENCODE_BLOCK + 1];
+        int k, nfull;
 
-#ifdef BOUNDS_HEAP_PRESENT
-        /*
-         * lookup component in interval heap
-         */
-        int64_t v = *label;
-        int heapind = 1;
-        int n = codec->intboundsnum;
-        while (__LIKELY(heapind <= n)) {
-            heapind = heapind*2 + (int)(v >= codec->intboundsheap[heapind]);
+        /* codes and bit lengths, components are independent */
+        for (k = 0; k < ENCODE_BLOCK; k++) {
+            const struct interval *in =
+                codec->intervals + lookup_interval(codec, label + k);
+            codes[k] = ((uint64_t)label[k] + (uint64_t)in->bias)
+                << (64 - in->bitlen);
+            offs[k + 1] = in->bitlen;
         }
-        intind = heapind - n;
-#endif
 
-#ifdef ORDPATH_SSE2_SEARCHTREE
-        /*
-         * lookup component in interval search tree
-         */
-        __m128i v, deltalo, deltahi, pkdelta, m;
-        const __m128i *p;
-        int indlo, indhi;
+        /* exclusive prefix sum: output bit offsets */
+        offs[0] = accused;
+        for (k = 0; k < ENCODE_BLOCK; k++) {
+            offs[k + 1] += offs[k];
+        }
 
-        v = _mm_shuffle_epi32(
-                        _mm_loadl_epi64((const __m128i *)label),
-                        _MM_SHUFFLE(1, 0, 1, 0));
+        bb_store(words, acc);
+#if defined(__SIZEOF_INT128__)
+        if (offs[ENCODE_BLOCK] <= 128) {
+            /* short codes: merge in a register pair */
+            unsigned __int128 x = (unsigned __int128)(uint64_t)words[0] << 64;
+            for (k = 0; k < ENCODE_BLOCK; k++) {
+                x |= ((unsigned __int128)codes[k] << 64) >> offs[k];
+            }
+            words[0] = (int64_t)(uint64_t)(x >> 64);
+            words[1] = (int64_t)(uint64_t)x;
+            words[2] = 0;
+        } else
+#endif
+        {
+            /*
+             * a code spans at most 2 words, the low part is shifted in
+             * two steps since the shift count may be 64
+             */
+            memset(words + 1, 0, (ENCODE_BLOCK + 1) * sizeof words[0]);
+            for (k = 0; k < ENCODE_BLOCK; k++) {
+                int w = offs[k] / 64, sh = offs[k] % 64;
+                words[w] |= codes[k] >> sh;
+                words[w + 1] |= codes[k] << 1 << (63 - sh);
+            }
+        }
 
-        p = codec->intbounds5tree;
-        deltalo = _mm_sub_epi64(v, p[0]);
-        deltahi = _mm_sub_epi64(v, p[1]);
-        pkdelta = _mm_packs_epi32(deltalo, deltahi);
-        m = _mm_srai_epi32(pkdelta, 31);
-        indhi = __builtin_ctz(~_mm_movemask_epi8(m));
+        nfull = offs[ENCODE_BLOCK] / 64;
+        if (exact && outsize - (size_t)(out - outbuf) < 8 * (size_t)nfull) {
+            bb_cleanup();
+            return ORDPATH_BUFTOOSMALL;
+        }
+        for (k = 0; k < nfull; k++) {
+            if (unaligned) {
+                bb_storeu_be(out, bb_load(words + k), 8);
+            } else {
+                bb_store_be((int64_t *)out, bb_load(words + k));
+            }
+            out += 8;
+        }
+        acc = bb_load(words + nfull);
+        accused = offs[ENCODE_BLOCK] % 64;
+        label += ENCODE_BLOCK;
+    }
+#endif
 
-        p = (const void *)((uintptr_t)p + 32 + indhi*8);
-        deltalo = _mm_sub_epi64(v, p[0]);
-        deltahi = _mm_sub_epi64(v, p[1]);
-        pkdelta = _mm_packs_epi32(deltalo, deltahi);
-        m = _mm_srai_epi32(pkdelta, 31);
-        indlo = __builtin_ctz(~_mm_movemask_epi8(m));
+    while (label < endlabel) {
+        bitbuf_t c;
+        int intind, bitlen;
 
-        intind = (indhi*5 + indlo + 4) >> 2;
-#endif
+        intind = lookup_interval(codec, label);
 
         /*
          * load label component (again)
@@ -586,51 +818,243 @@ ordpath_encode(
         acc = bb_or(acc, bb_shr(c, accused));
         accused += bitlen;
         if (__UNLIKELY(accused >= 64)) {
-            bb_store_be(out++, acc);
+            if (exact && outsize - (size_t)(out - outbuf) < 8) {
+                bb_cleanup();
+                return ORDPATH_BUFTOOSMALL;
+            }
+            if (unaligned) {
+                bb_storeu_be(out, acc, 8);
+            } else {
+                bb_store_be((int64_t *)out, acc);
+            }
+            out += 8;
             accused -= 64;
             acc = bb_shl(c, bitlen - accused);
         }
     }
-    bb_store_be(out, acc);
-    *poutbitlen = CHAR_BIT * ((char *)out - outbuf) + accused;
+    if (exact && outsize - (size_t)(out - outbuf)
+            < (size_t)(accused + CHAR_BIT - 1) / CHAR_BIT) {
+        bb_cleanup();
+        return ORDPATH_BUFTOOSMALL;
+    }
+    if (unaligned) {
+        int size = (accused + CHAR_BIT - 1) / CHAR_BIT;
+        unsigned char tail = 0;
+        if (keeptail && accused % CHAR_BIT) {
+            tail = (unsigned char)out[size - 1]
+                & (0xff >> accused % CHAR_BIT);
+        }
+        bb_storeu_be(out, acc, size);
+        if (tail) {
+            out[size - 1] |= tail;
+        }
+    } else {
+        bb_store_be((int64_t *)out, acc);
+    }
+    *poutbitlen = CHAR_BIT * (out - outbuf) + accused - bitoff;
     bb_cleanup();
     return ORDPATH_SUCCESS;
 }
 
 status_t
-ordpath_decode(
+ordpath_encode(
+    const codec_t *restrict codec,
+    const int64_t *restrict label,
+    size_t lablen,
+    char *restrict outbuf,
+    size_t *restrict poutbitlen)
+{
+#ifndef NDEBUG
+    /*
+     * rejecting unaligned buffer
+     */
+    if ((uintptr_t)outbuf & (ORDPATH_BUF_ALIGNMENT - 1)) {
+        DEBUG("Unaligned buffer, expected alignment %d",
+            ORDPATH_BUF_ALIGNMENT);
+        return ORDPATH_INVAL;
+    }
+#endif
+
+    return encode_core(codec, label, lablen, outbuf, 0, 0,
+            poutbitlen, 0, 0, 0);
+}
+
+status_t
+ordpath_encode_at(
+    const codec_t *restrict codec,
+    const int64_t *restrict label,
+    size_t lablen,
+    char *restrict outbuf,
+    size_t outbitoff,
+    size_t *restrict poutbitlen)
+{
+    return encode_core(codec, label, lablen,
+            outbuf + outbitoff / CHAR_BIT, outbitoff % CHAR_BIT, 0,
+            poutbitlen, 1, 0, 1);
+}
+
+status_t
+ordpath_encode_exact(
+    const codec_t *restrict codec,
+    const int64_t *restrict label,
+    size_t lablen,
+    char *restrict outbuf,
+    size_t outbufsize,
+    size_t *restrict poutbitlen)
+{
+    return encode_core(codec, label, lablen, outbuf, 0, outbufsize,
+            poutbitlen, 1, 1, 0);
+}
+
+status_t
+ordpath_encoded_bitlen(
+    const codec_t *restrict codec,
+    const int64_t *restrict label,
+    size_t lablen,
+    size_t *restrict pbitlen)
+{
+    size_t bitlen = 0;
+
+    for (size_t i = 0; i < lablen; i++) {
+        bitlen += codec->intervals[lookup_interval(codec, label + i)].bitlen;
+    }
+    *pbitlen = bitlen;
+    return ORDPATH_SUCCESS;
+}
+
+status_t
+ordpath_decoded_maxlen(
     const codec_t *restrict codec,
-    const char *restrict inbuf,
     size_t inbitlen,
-    int64_t *restrict label,
-    size_t *restrict plablen)
+    size_t *restrict pmaxlen)
 {
+    *pmaxlen = inbitlen / codec->minbitlen;
+    return ORDPATH_SUCCESS;
+}
+
 #if defined(bb_high_byte) && PREFIX_LEN_MAX == 8
 #define make_tab_ind(x)   bb_high_byte((x))
 #else
 #define make_tab_ind(x)   bb_to_int(bb_shr((x), 64 - PREFIX_LEN_MAX))
 #endif
 
+#if defined(ORDPATH_WIDE_DECODER)
+
+/*
+ * Decoder (128 bit window). Same interface as the regular decoder
+ * below. The window (hi:lo register pair) always holds at least 64 bits
+ * hence a component takes exactly one table lookup. The window is
+ * refilled unconditionally after every component (a zero word is merged
+ * if there is no room). Loads beyond the label end are redirected to a
+ * zero word (or to the copy of the partial last word in unaligned mode).
+ */
+static inline status_t decode_core(
+    const codec_t *restrict codec,
+    const char *restrict inbuf,
+    int bitoff,
+    size_t inbitlen,
+    int64_t *restrict label,
+    size_t *restrict plablen,
+    const int unaligned)
+{
+    static const char zero[8] = {0};
+    char tail[8] = {0};
+    int64_t *out = label;
+    const char *in = inbuf, *wordsend;
+    uint64_t hi, lo;
+    size_t pos = 0;
+    int avail;
+
+    if (unaligned) {
+        size_t size = (bitoff + inbitlen + CHAR_BIT - 1) / CHAR_BIT;
+        wordsend = inbuf + size / 8 * 8;
+        memcpy(tail, wordsend, size % 8);
+    } else {
+        wordsend = inbuf + (bitoff + inbitlen + 63) / 64 * 8;
+    }
+
+#define WINDOW_WORD(p) \
+    load_be64((p) < wordsend ? (p) : (unaligned && (p) == wordsend) ? \
+        (const char *)tail : zero)
+
+    hi = WINDOW_WORD(in);
+    lo = WINDOW_WORD(in + 8);
+    in += 16;
+    if (bitoff) {
+        hi = hi << bitoff | lo >> (64 - bitoff);
+        lo <<= bitoff;
+    }
+    avail = 128 - bitoff;
+
+    while (pos < inbitlen) {
+        int intind = codec->intlookuptab[hi >> (64 - PREFIX_LEN_MAX)];
+        int bitlen = codec->intervals[intind].bitlen, need;
+        uint64_t w;
+
+        if (__UNLIKELY(intind == 0 || inbitlen - pos < (size_t)bitlen)) {
+            *plablen = out - label;
+            return ORDPATH_CORRUPTDATA;
+        }
+
+        /* 1 <= bitlen <= 63 */
+        *out++ = (int64_t)((hi >> (64 - bitlen))
+                - (uint64_t)codec->intervals[intind].bias);
+        pos += bitlen;
+        hi = hi << bitlen | lo >> (64 - bitlen);
+        lo <<= bitlen;
+        avail -= bitlen;
+
+        /* refill, branch-free; 1 <= avail <= 127 */
+        need = avail <= 64;
+        w = WINDOW_WORD(in) & -(uint64_t)need;
+        hi |= (w >> 1) >> ((avail - 1) & 63);
+        lo |= w << ((64 - avail) & 63);
+        in += 8 * need;
+        avail += 64 * need;
+    }
+
+#undef WINDOW_WORD
+
+    *plablen = out - label;
+    return ORDPATH_SUCCESS;
+}
+
+#else
+
+/*
+ * Decoder. Input starts at *bitoff* bit of inbuf[0] (bitoff < 8). If
+ * *unaligned* is set, inbuf is an arbitrary address and nothing is read
+ * past the last byte of the label. Otherwise inbuf is aligned and the
+ * label is read in whole 64 bit words.
+ */
+static inline status_t decode_core(
+    const codec_t *restrict codec,
+    const char *restrict inbuf,
+    int bitoff,
+    size_t inbitlen,
+    int64_t *restrict label,
+    size_t *restrict plablen,
+    const int unaligned)
+{
     int64_t *out = label;
-    const int64_t *in;
+    const char *in = inbuf;
     bitbuf_t acc;
     int accused, bitlen;
 
-#ifndef NDEBUG
-    /*
-     * rejecting unaligned buffer
-     */
-    if ((uintptr_t)inbuf & (ORDPATH_BUF_ALIGNMENT - 1)) {
-        DEBUG("Unaligned buffer, expected alignment %d",
-            ORDPATH_BUF_ALIGNMENT);
-        return ORDPATH_INVAL;
-    }
-#endif
-
-    in = (const int64_t *)inbuf;
     acc = bb_zero();
     accused = 0;
 
+    if (bitoff) {
+        /* bit-aligned prologue: skip leading bits of the first word */
+        inbitlen += bitoff;
+        accused = (inbitlen > 64) ? 64 : inbitlen;
+        acc = bb_shl(bb_loadu_be(in, (accused + CHAR_BIT - 1) / CHAR_BIT),
+                bitoff);
+        in += 8;
+        inbitlen -= accused;
+        accused -= bitoff;
+    }
+
     while (1) {
         int tabind, intind;
         tabind = make_tab_ind(acc);
@@ -646,11 +1070,24 @@ ordpath_decode(
             bitbuf_t c = acc;
             int accused_prev = accused;
 
+            /* 64 bits availible but no valid prefix found */
+            if (__UNLIKELY(accused_prev == 64)) {
+                *plablen = out - label;
+                bb_cleanup();
+                return ORDPATH_CORRUPTDATA;
+            }
+
             /* fill acc */
             accused = 0;
             if (__LIKELY(inbitlen != 0)) {
                 accused = (__LIKELY(inbitlen > 64)) ? 64 : inbitlen;
-                acc = bb_load_be(in++);
+                if (unaligned) {
+                    acc = bb_loadu_be(in,
+                            (accused + CHAR_BIT - 1) / CHAR_BIT);
+                } else {
+                    acc = bb_load_be((const int64_t *)in);
+                }
+                in += 8;
                 inbitlen -= accused;
             }
 
@@ -681,3 +1118,3076 @@ ordpath_decode(
     /* unreached */
 }
 
+#endif
+
+status_t
+ordpath_decode(
+    const codec_t *restrict codec,
+    const char *restrict inbuf,
+    size_t inbitlen,
+    int64_t *restrict label,
+    size_t *restrict plablen)
+{
+#ifndef NDEBUG
+    /*
+     * rejecting unaligned buffer
+     */
+    if ((uintptr_t)inbuf & (ORDPATH_BUF_ALIGNMENT - 1)) {
+        DEBUG("Unaligned buffer, expected alignment %d",
+            ORDPATH_BUF_ALIGNMENT);
+        return ORDPATH_INVAL;
+    }
+#endif
+
+    return decode_core(codec, inbuf, 0, inbitlen, label, plablen, 0);
+}
+
+status_t
+ordpath_decode_at(
+    const codec_t *restrict codec,
+    const char *restrict inbuf,
+    size_t inbitoff,
+    size_t inbitlen,
+    int64_t *restrict label,
+    size_t *restrict plablen)
+{
+    return decode_core(codec, inbuf + inbitoff / CHAR_BIT,
+            inbitoff % CHAR_BIT, inbitlen, label, plablen, 1);
+}
+
+
+
+/*
+ * Self-delimiting labels. A label is followed by the end-of-label code
+ * defined in the setup ("<prefix> : end"), labels concatenated in a
+ * single bitstream are split without knowing their lengths. The code
+ * is reserved (intlookuptab maps it to 0) hence the decoder below
+ * only checks for it when no valid prefix is found.
+ */
+
+/*
+ * Append the end-of-label code at *bitpos* bit of outbuf, trailing
+ * bits of the last byte are cleared (like encode_core does).
+ */
+static inline status_t put_terminator(
+    const codec_t *restrict codec,
+    char *restrict outbuf,
+    size_t bitpos,
+    size_t outsize)
+{
+    char *out = outbuf + bitpos / CHAR_BIT;
+    int shift = bitpos % CHAR_BIT;
+    unsigned t = (unsigned)codec->termcode << (16 - codec->termlen - shift);
+
+    if (outsize < (bitpos + codec->termlen + CHAR_BIT - 1) / CHAR_BIT) {
+        return ORDPATH_BUFTOOSMALL;
+    }
+    out[0] = (out[0] & (0xff << (CHAR_BIT - shift))) | (t >> 8);
+    if (shift + codec->termlen > CHAR_BIT) {
+        out[1] = t & 0xff;
+    }
+    return ORDPATH_SUCCESS;
+}
+
+#define IS_TERMINATOR(codec, x) \
+    (bb_to_int(bb_shr((x), 64 - (codec)->termlen)) == (codec)->termcode)
+
+/*
+ * Decode a label followed by the end-of-label code. Same as the
+ * regular decoder in unaligned mode but inbitlen is the number of bits
+ * availible (ex: the rest of a stream) and the label's length
+ * (including the code) is stored in *pbitlen. Label capacity is
+ * checked (labsize components). If *skip* is set, nothing is stored.
+ */
+static inline status_t decode_delimited_core(
+    const codec_t *restrict codec,
+    const char *restrict inbuf,
+    int bitoff,
+    size_t inbitlen,
+    int64_t *restrict label,
+    size_t labsize,
+    size_t *restrict plablen,
+    size_t *restrict pbitlen,
+    const int skip)
+{
+    const char *in = inbuf;
+    size_t total = inbitlen, n = 0;
+    bitbuf_t acc, c;
+    int accused, accused_prev, bitlen, tabind, intind;
+    status_t status = ORDPATH_CORRUPTDATA;
+
+    acc = bb_zero();
+    accused = 0;
+
+    if (bitoff) {
+        inbitlen += bitoff;
+        accused = (inbitlen > 64) ? 64 : inbitlen;
+        acc = bb_shl(bb_loadu_be(in, (accused + CHAR_BIT - 1) / CHAR_BIT),
+                bitoff);
+        in += 8;
+        inbitlen -= accused;
+        accused -= bitoff;
+    }
+
+    while (1) {
+        tabind = make_tab_ind(acc);
+        intind = codec->intlookuptab[tabind];
+        bitlen = codec->intervals[intind].bitlen;
+        if (__LIKELY(accused > bitlen)) {
+            if (!skip) {
+                if (__UNLIKELY(n == labsize)) {
+                    status = ORDPATH_BUFTOOSMALL;
+                    goto out;
+                }
+                bb_store(label + n, bb_sub(
+                        bb_shr(acc, 64 - bitlen),
+                        bb_load(&codec->intervals[intind].bias)));
+            }
+            n++;
+            accused -= bitlen;
+            acc = bb_shl(acc, bitlen);
+            continue;
+        }
+
+        /* the code is reserved, enough bits to tell */
+        if (intind == 0 && accused >= codec->termlen
+                && IS_TERMINATOR(codec, acc)) {
+            break;
+        }
+
+        /* 64 bits availible but no valid prefix found */
+        if (__UNLIKELY(accused == 64)) {
+            goto out;
+        }
+
+        c = acc;
+        accused_prev = accused;
+
+        /* fill acc */
+        accused = 0;
+        if (__LIKELY(inbitlen != 0)) {
+            accused = (__LIKELY(inbitlen > 64)) ? 64 : inbitlen;
+            acc = bb_loadu_be(in, (accused + CHAR_BIT - 1) / CHAR_BIT);
+            in += 8;
+            inbitlen -= accused;
+        }
+
+        c = bb_or(c, bb_shr(acc, accused_prev));
+        tabind = make_tab_ind(c);
+        intind = codec->intlookuptab[tabind];
+        bitlen = codec->intervals[intind].bitlen;
+
+        /* not enough bits? either the end of label or truncated data */
+        if (__UNLIKELY(bitlen > accused_prev + accused)) {
+            if (intind == 0 && accused_prev + accused >= codec->termlen
+                    && IS_TERMINATOR(codec, c)) {
+                accused += accused_prev;
+                break;
+            }
+            goto out;
+        }
+
+        if (!skip) {
+            if (__UNLIKELY(n == labsize)) {
+                status = ORDPATH_BUFTOOSMALL;
+                goto out;
+            }
+            bb_store(label + n, bb_sub(
+                    bb_shr(c, 64 - bitlen),
+                    bb_load(&codec->intervals[intind].bias)));
+        }
+        n++;
+        accused -= bitlen - accused_prev;
+        acc = bb_shl(acc, bitlen - accused_prev);
+    }
+
+    /* bits loaded minus bits left in acc */
+    *plablen = n;
+    *pbitlen = total - inbitlen - accused + codec->termlen;
+    status = ORDPATH_SUCCESS;
+out:
+    bb_cleanup();
+    return status;
+}
+
+status_t
+ordpath_encode_delimited(
+    const codec_t *restrict codec,
+    const int64_t *restrict label,
+    size_t lablen,
+    char *restrict outbuf,
+    size_t outbitoff,
+    size_t outbufsize,
+    size_t *restrict poutbitlen)
+{
+    status_t status;
+    size_t bitlen;
+
+    if (!codec->termlen) {
+        DEBUG("Setup defines no end-of-label code");
+        return ORDPATH_INVAL;
+    }
+    /* the first byte is read to keep the leading bits */
+    if (outbufsize < (outbitoff + CHAR_BIT - 1) / CHAR_BIT) {
+        return ORDPATH_BUFTOOSMALL;
+    }
+    status = encode_core(codec, label, lablen,
+            outbuf + outbitoff / CHAR_BIT, outbitoff % CHAR_BIT,
+            outbufsize - outbitoff / CHAR_BIT, &bitlen, 1, 1, 0);
+    if (status != ORDPATH_SUCCESS) {
+        return status;
+    }
+    status = put_terminator(codec, outbuf, outbitoff + bitlen, outbufsize);
+    if (status != ORDPATH_SUCCESS) {
+        return status;
+    }
+    *poutbitlen = bitlen + codec->termlen;
+    return ORDPATH_SUCCESS;
+}
+
+status_t
+ordpath_decode_delimited(
+    const codec_t *restrict codec,
+    const char *restrict inbuf,
+    size_t inbitoff,
+    size_t inbitlen,
+    int64_t *restrict label,
+    size_t labsize,
+    size_t *restrict plablen,
+    size_t *restrict plabelbitlen)
+{
+    if (!codec->termlen) {
+        DEBUG("Setup defines no end-of-label code");
+        return ORDPATH_INVAL;
+    }
+    return decode_delimited_core(codec, inbuf + inbitoff / CHAR_BIT,
+            inbitoff % CHAR_BIT, inbitlen, label, labsize,
+            plablen, plabelbitlen, 0);
+}
+
+status_t
+ordpath_skip_delimited(
+    const codec_t *restrict codec,
+    const char *restrict inbuf,
+    size_t inbitoff,
+    size_t inbitlen,
+    size_t *restrict plabelbitlen)
+{
+    size_t lablen;
+
+    if (!codec->termlen) {
+        DEBUG("Setup defines no end-of-label code");
+        return ORDPATH_INVAL;
+    }
+    return decode_delimited_core(codec, inbuf + inbitoff / CHAR_BIT,
+            inbitoff % CHAR_BIT, inbitlen, NULL, 0,
+            &lablen, plabelbitlen, 1);
+}
+
+
+
+/*
+ * Batch decoder. Labels are independent hence decoding several labels
+ * simultaneously hides the latency of the load -> table lookup -> shift
+ * dependency chain. A lane carries the complete state of the decoder
+ * loop (see ordpath_decode()). Lanes are advanced in a round-robin
+ * fashion one component at a time. A lane that has finished with its
+ * label picks the next label from the batch immediately.
+ */
+
+#define BATCH_LANES            4
+#define NOLABEL                SIZE_MAX
+
+struct declane {
+    const int64_t             *in;
+    size_t                     inbitlen;
+    bitbuf_t                   acc;
+    int                        accused;
+    int64_t                   *out;
+    size_t                     index;
+};
+
+/*
+ * Decode the next component. Returns 1 if a component was produced and
+ * 0 if the label is over; status is stored in location pointed by
+ * *pstatus in the later case.
+ */
+static inline int decode_step(
+    const codec_t *restrict codec,
+    struct declane *restrict lane,
+    status_t *restrict pstatus)
+{
+    int tabind, intind, bitlen;
+    tabind = make_tab_ind(lane->acc);
+    intind = codec->intlookuptab[tabind];
+    bitlen = codec->intervals[intind].bitlen;
+    if (__LIKELY(lane->accused > bitlen)) {
+        bb_store(lane->out++, bb_sub(
+                bb_shr(lane->acc, 64 - bitlen),
+                bb_load(&codec->intervals[intind].bias)));
+        lane->accused -= bitlen;
+        lane->acc = bb_shl(lane->acc, bitlen);
+    } else {
+        bitbuf_t c = lane->acc;
+        int accused_prev = lane->accused;
+
+        /* 64 bits availible but no valid prefix found */
+        if (__UNLIKELY(accused_prev == 64)) {
+            *pstatus = ORDPATH_CORRUPTDATA;
+            return 0;
+        }
+
+        /* fill acc */
+        lane->accused = 0;
+        if (__LIKELY(lane->inbitlen != 0)) {
+            lane->accused = (__LIKELY(lane->inbitlen > 64)) ?
+                    64 : lane->inbitlen;
+            lane->acc = bb_load_be(lane->in++);
+            lane->inbitlen -= lane->accused;
+        }
+
+        /* see ordpath_decode() */
+        c = bb_or(c, bb_shr(lane->acc, accused_prev));
+        tabind = make_tab_ind(c);
+        intind = codec->intlookuptab[tabind];
+        bitlen = codec->intervals[intind].bitlen;
+
+        if (__UNLIKELY(bitlen > accused_prev + lane->accused)) {
+            *pstatus = (lane->accused + accused_prev == 0) ?
+                    ORDPATH_SUCCESS : ORDPATH_CORRUPTDATA;
+            return 0;
+        }
+
+        bb_store(lane->out++, bb_sub(
+                bb_shr(c, 64 - bitlen),
+                bb_load(&codec->intervals[intind].bias)));
+        lane->accused -= bitlen - accused_prev;
+        lane->acc = bb_shl(lane->acc, bitlen - accused_prev);
+    }
+    return 1;
+}
+
+status_t
+ordpath_decode_batch(
+    const codec_t *restrict codec,
+    size_t n,
+    const char * const inbufs[],
+    const size_t inbitlens[],
+    int64_t * const labels[],
+    size_t lablens[],
+    status_t statuses[])
+{
+    struct declane lanes [BATCH_LANES];
+    int active [BATCH_LANES];
+    status_t lanestatus [BATCH_LANES];
+    size_t next = 0, failed = n;
+    int nactive = 0;
+    status_t status = ORDPATH_SUCCESS;
+    int i;
+
+    for (i = 0; i < BATCH_LANES; i++) {
+        active[i] = 0;
+        lanes[i].index = NOLABEL;
+    }
+
+    while (1) {
+        /* assign pending labels to idle lanes */
+        for (i = 0; i < BATCH_LANES && next < n; i++) {
+            if (active[i]) {
+                continue;
+            }
+#ifndef NDEBUG
+            /*
+             * rejecting unaligned buffer
+             */
+            if ((uintptr_t)inbufs[next] & (ORDPATH_BUF_ALIGNMENT - 1)) {
+                DEBUG("Unaligned buffer, expected alignment %d",
+                    ORDPATH_BUF_ALIGNMENT);
+                lablens[next] = 0;
+                if (statuses) {
+                    statuses[next] = ORDPATH_INVAL;
+                }
+                if (next < failed) {
+                    failed = next;
+                    status = ORDPATH_INVAL;
+                }
+                next++;
+                i--;
+                continue;
+            }
+#endif
+            lanes[i].in = (const int64_t *)inbufs[next];
+            lanes[i].inbitlen = inbitlens[next];
+            lanes[i].acc = bb_zero();
+            lanes[i].accused = 0;
+            lanes[i].out = labels[next];
+            lanes[i].index = next;
+            active[i] = 1;
+            nactive++;
+            next++;
+        }
+
+        if (__UNLIKELY(nactive == 0)) {
+            break;
+        }
+
+        if (__LIKELY(nactive == BATCH_LANES)) {
+            /*
+             * every lane is busy; keep lanes in local variables hence
+             * the compiler is free to hold state in registers
+             */
+            struct declane l0 = lanes[0], l1 = lanes[1],
+                           l2 = lanes[2], l3 = lanes[3];
+            int r0, r1, r2, r3;
+#if BATCH_LANES != 4
+#error adjust ordpath_decode_batch()
+#endif
+            do {
+                r0 = decode_step(codec, &l0, &lanestatus[0]);
+                r1 = decode_step(codec, &l1, &lanestatus[1]);
+                r2 = decode_step(codec, &l2, &lanestatus[2]);
+                r3 = decode_step(codec, &l3, &lanestatus[3]);
+            } while (__LIKELY(r0 & r1 & r2 & r3));
+            lanes[0] = l0; active[0] = r0;
+            lanes[1] = l1; active[1] = r1;
+            lanes[2] = l2; active[2] = r2;
+            lanes[3] = l3; active[3] = r3;
+        } else {
+            /* ragged tail: advance the remaining lanes */
+            for (i = 0; i < BATCH_LANES; i++) {
+                if (active[i]) {
+                    active[i] = decode_step(codec, lanes + i, &lanestatus[i]);
+                }
+            }
+        }
+
+        /* retire lanes that are done with their labels */
+        for (i = 0; i < BATCH_LANES; i++) {
+            size_t ind;
+            if (active[i] || lanes[i].index == NOLABEL) {
+                continue;
+            }
+            ind = lanes[i].index;
+            lablens[ind] = lanes[i].out - labels[ind];
+            if (statuses) {
+                statuses[ind] = lanestatus[i];
+            }
+            if (lanestatus[i] != ORDPATH_SUCCESS && ind < failed) {
+                failed = ind;
+                status = lanestatus[i];
+            }
+            lanes[i].index = NOLABEL;
+            nactive--;
+        }
+    }
+
+    bb_cleanup();
+    return status;
+}
+
+/*
+ * Hashing encoded labels. Encoded label is processed in 64 bit words.
+ * Bits beyond the label end are masked hence the hash doesn't depend
+ * on the padding. Even and odd words are fed to distinct accumulators
+ * to break the dependency chain.
+ */
+
+#define HASH_SEED              UINT64_C(0x9e3779b97f4a7c15)
+#define HASH_K1                UINT64_C(0x87c37b91114253d5)
+#define HASH_K2                UINT64_C(0x4cf5ad432745937f)
+
+static inline uint64_t hash_fmix(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= UINT64_C(0xff51afd7ed558ccd);
+    h ^= h >> 33;
+    h *= UINT64_C(0xc4ceb9fe1a85ec53);
+    h ^= h >> 33;
+    return h;
+}
+
+static inline uint64_t hash_step(uint64_t h, uint64_t w)
+{
+#if defined(ORDPATH_SSE42_CRC32C)
+    return _mm_crc32_u64(h, w);
+#else
+    h ^= w * HASH_K1;
+    return (h << 31 | h >> 33) * HASH_K2;
+#endif
+}
+
+uint64_t
+ordpath_hash(
+    const char *restrict inbuf,
+    size_t inbitlen)
+{
+    const char *p = inbuf;
+    size_t nwords = inbitlen / 64;
+    int tailbits = inbitlen % 64;
+    uint64_t h1 = HASH_SEED, h2 = ~HASH_SEED;
+
+    for (; nwords >= 2; nwords -= 2, p += 16) {
+        h1 = hash_step(h1, load_be64(p));
+        h2 = hash_step(h2, load_be64(p + 8));
+    }
+    if (nwords) {
+        h1 = hash_step(h1, load_be64(p));
+        p += 8;
+    }
+    if (tailbits) {
+        /* mask bits beyond the label end */
+        h2 = hash_step(h2, load_be64(p) & (~UINT64_C(0) << (64 - tailbits)));
+    }
+    return hash_fmix((h1 << 32 | h1 >> 32) ^ h2 ^ (uint64_t)inbitlen);
+}
+
+void
+ordpath_hash_batch(
+    size_t n,
+    const char * const inbufs[],
+    const size_t inbitlens[],
+    uint64_t hashes[])
+{
+    size_t i;
+    for (i = 0; i < n; i++) {
+        hashes[i] = ordpath_hash(inbufs[i], inbitlens[i]);
+    }
+}
+
+/*
+ * Scanner. Used by functions examining an encoded label without
+ * decoding it. Splits an encoded label into components exactly like
+ * the decoder does (see ordpath_decode()) but produces raw codes, no
+ * bias subtraction and no stores.
+ */
+
+struct scanner {
+    const char                *in;
+    size_t                     inbitlen;
+    uint64_t                   acc;
+    int                        accused;
+    size_t                     pos;
+};
+
+/*
+ * Scan the next component. Returns interval index, 0 if the label is
+ * over or corrupt (corrupt unless scanner->pos == inbitlen). The
+ * encoded component is stored in location pointed by *pcode.
+ */
+static inline int scan_next(
+    const codec_t *restrict codec,
+    struct scanner *restrict sc,
+    uint64_t *restrict pcode)
+{
+    int intind, bitlen;
+    intind = codec->intlookuptab[sc->acc >> (64 - PREFIX_LEN_MAX)];
+    bitlen = codec->intervals[intind].bitlen;
+    if (__LIKELY(sc->accused > bitlen)) {
+        *pcode = sc->acc >> (64 - bitlen);
+        sc->accused -= bitlen;
+        sc->acc <<= bitlen;
+    } else {
+        uint64_t c = sc->acc;
+        int accused_prev = sc->accused;
+
+        /* fill acc */
+        sc->accused = 0;
+        if (__LIKELY(sc->inbitlen != 0)) {
+            sc->accused = (__LIKELY(sc->inbitlen > 64)) ? 64 : sc->inbitlen;
+            sc->acc = load_be64(sc->in);
+            sc->in += 8;
+            sc->inbitlen -= sc->accused;
+        }
+
+        /* 64 bits availible but no valid prefix found */
+        if (__UNLIKELY(accused_prev == 64)) {
+            return 0;
+        }
+
+        c |= sc->acc >> accused_prev;
+        intind = codec->intlookuptab[c >> (64 - PREFIX_LEN_MAX)];
+        bitlen = codec->intervals[intind].bitlen;
+
+        /* not enough bits? */
+        if (__UNLIKELY(bitlen > accused_prev + sc->accused)) {
+            /* trailing junk is reported by leaving pos short */
+            return 0;
+        }
+
+        *pcode = c >> (64 - bitlen);
+        sc->accused -= bitlen - accused_prev;
+        sc->acc <<= bitlen - accused_prev;
+    }
+    sc->pos += bitlen;
+    return intind;
+}
+
+#define SCANNER_INIT(inbuf, inbitlen)  { (inbuf), (inbitlen), 0, 0, 0 }
+
+/*
+ * Component is odd iff (code - bias) is odd, no need to subtract.
+ */
+#define IS_ODD_COMPONENT(codec, intind, code) \
+    (int)(((code) ^ (uint64_t)(codec)->intervals[(intind)].bias) & 1)
+
+/*
+ * Count levels (odd components) in an encoded label. Additionally
+ * determines where the parent's label ends (the end of the last but one
+ * odd component).
+ */
+static inline status_t scan_levels(
+    const codec_t *restrict codec,
+    const char *restrict inbuf,
+    size_t inbitlen,
+    size_t *restrict pdepth,
+    size_t *restrict pparentbitlen)
+{
+    struct scanner sc = SCANNER_INIT(inbuf, inbitlen);
+    size_t depth = 0, lastodd = 0, parent = 0;
+    uint64_t code;
+    int intind, odd;
+    while ((intind = scan_next(codec, &sc, &code))) {
+        odd = IS_ODD_COMPONENT(codec, intind, code);
+        depth += odd;
+        parent = odd ? lastodd : parent;
+        lastodd = odd ? sc.pos : lastodd;
+    }
+    if (__UNLIKELY(sc.pos != inbitlen)) {
+        return ORDPATH_CORRUPTDATA;
+    }
+    *pdepth = depth;
+    *pparentbitlen = parent;
+    return ORDPATH_SUCCESS;
+}
+
+status_t
+ordpath_depth(
+    const codec_t *restrict codec,
+    const char *restrict inbuf,
+    size_t inbitlen,
+    size_t *restrict pdepth)
+{
+    size_t parentbitlen;
+    return scan_levels(codec, inbuf, inbitlen, pdepth, &parentbitlen);
+}
+
+status_t
+ordpath_parent(
+    const codec_t *restrict codec,
+    const char *restrict inbuf,
+    size_t inbitlen,
+    size_t *restrict pparentbitlen)
+{
+    size_t depth;
+    return scan_levels(codec, inbuf, inbitlen, &depth, pparentbitlen);
+}
+
+status_t
+ordpath_depth_batch(
+    const codec_t *restrict codec,
+    size_t n,
+    const char * const inbufs[],
+    const size_t inbitlens[],
+    size_t depths[],
+    status_t statuses[])
+{
+    status_t status = ORDPATH_SUCCESS, t;
+    size_t i, parentbitlen;
+    for (i = 0; i < n; i++) {
+        t = scan_levels(codec, inbufs[i], inbitlens[i],
+                depths + i, &parentbitlen);
+        if (statuses) {
+            statuses[i] = t;
+        }
+        if (t != ORDPATH_SUCCESS && status == ORDPATH_SUCCESS) {
+            status = t;
+        }
+    }
+    return status;
+}
+
+status_t
+ordpath_parent_batch(
+    const codec_t *restrict codec,
+    size_t n,
+    const char * const inbufs[],
+    const size_t inbitlens[],
+    size_t parentbitlens[],
+    status_t statuses[])
+{
+    status_t status = ORDPATH_SUCCESS, t;
+    size_t i, depth;
+    for (i = 0; i < n; i++) {
+        t = scan_levels(codec, inbufs[i], inbitlens[i],
+                &depth, parentbitlens + i);
+        if (statuses) {
+            statuses[i] = t;
+        }
+        if (t != ORDPATH_SUCCESS && status == ORDPATH_SUCCESS) {
+            status = t;
+        }
+    }
+    return status;
+}
+
+/*
+ * The number of leading bits shared by two bitstrings (at most maxbits).
+ */
+static inline size_t bits_common_prefix(
+    const char *a,
+    const char *b,
+    size_t maxbits)
+{
+    size_t pos;
+    for (pos = 0; pos < maxbits; pos += 64) {
+        uint64_t x = load_be64(a + pos/8) ^ load_be64(b + pos/8);
+        if (x) {
+            pos += __builtin_clzll(x);
+            break;
+        }
+    }
+    return pos < maxbits ? pos : maxbits;
+}
+
+/*
+ * Compare bitstrings in document order; a prefix precedes longer
+ * strings.
+ */
+static inline int bits_cmp(
+    const char *a,
+    size_t abitlen,
+    const char *b,
+    size_t bbitlen)
+{
+    size_t minbitlen = abitlen < bbitlen ? abitlen : bbitlen;
+    size_t pos = bits_common_prefix(a, b, minbitlen);
+    if (pos == minbitlen) {
+        return (abitlen > bbitlen) - (abitlen < bbitlen);
+    }
+    return (load_be64(a + pos/64*8) << pos%64 >> 63) ? 1 : -1;
+}
+
+/*
+ * Is A a proper ancestor of B? Encoding is prefix-free hence A is an
+ * ancestor iff A's encoded bits are a proper prefix of B's.
+ */
+static inline int bits_is_ancestor(
+    const char *a,
+    size_t abitlen,
+    const char *b,
+    size_t bbitlen)
+{
+    return abitlen < bbitlen && bits_common_prefix(a, b, abitlen) == abitlen;
+}
+
+/*
+ * Structural join (Stack-Tree-Desc). Candidate ancestors are pushed on
+ * a stack as they are met in document order; the stack always holds a
+ * chain of nested nodes. A descendant candidate is joined with every
+ * node on the stack (or with the top only if it is the parent).
+ */
+
+struct joinentry {
+    size_t                     index;
+    size_t                     depth;
+};
+
+status_t
+ordpath_join(
+    const codec_t *restrict codec,
+    ordpath_axis_t axis,
+    size_t na,
+    const char * const abufs[],
+    const size_t abitlens[],
+    size_t nd,
+    const char * const dbufs[],
+    const size_t dbitlens[],
+    int (*emit)(void *ctx, size_t a, size_t d),
+    void *ctx)
+{
+    struct joinentry stackbuf [64], *stack = stackbuf;
+    size_t stackcap = sizeof stackbuf / sizeof stackbuf[0];
+    size_t top = 0, a = 0, d = 0, i;
+    status_t status = ORDPATH_SUCCESS;
+
+    if (!codec->ordered) {
+        DEBUG("Codec doesn't preserve order");
+        return ORDPATH_INVAL;
+    }
+
+    while (d < nd) {
+        const char *cur;
+        size_t curbitlen, depth = 0;
+        int isanc;
+
+        isanc = a < na && bits_cmp(abufs[a], abitlens[a],
+                dbufs[d], dbitlens[d]) < 0;
+        cur = isanc ? abufs[a] : dbufs[d];
+        curbitlen = isanc ? abitlens[a] : dbitlens[d];
+
+        /* pop nodes that are not ancestors of the current one */
+        while (top && !bits_is_ancestor(
+                    abufs[stack[top-1].index], abitlens[stack[top-1].index],
+                    cur, curbitlen)) {
+            top--;
+        }
+
+        if (axis == ORDPATH_AXIS_CHILD && (isanc || top)) {
+            status = ordpath_depth(codec, cur, curbitlen, &depth);
+            if (status != ORDPATH_SUCCESS) {
+                goto out;
+            }
+        }
+
+        if (isanc) {
+            if (__UNLIKELY(top == stackcap)) {
+                struct joinentry *t = malloc(2 * stackcap * sizeof *t);
+                if (!t) {
+                    status = ORDPATH_OUTOFMEM;
+                    goto out;
+                }
+                memcpy(t, stack, stackcap * sizeof *t);
+                if (stack != stackbuf) {
+                    free(stack);
+                }
+                stack = t;
+                stackcap *= 2;
+            }
+            stack[top].index = a++;
+            stack[top].depth = depth;
+            top++;
+            continue;
+        }
+
+        if (axis == ORDPATH_AXIS_CHILD) {
+            if (top && stack[top-1].depth + 1 == depth
+                    && emit(ctx, stack[top-1].index, d)) {
+                goto out;
+            }
+        } else {
+            for (i = 0; i < top; i++) {
+                if (emit(ctx, stack[i].index, d)) {
+                    goto out;
+                }
+            }
+        }
+        d++;
+    }
+
+out:
+    if (stack != stackbuf) {
+        free(stack);
+    }
+    return status;
+}
+
+/*
+ * Common prefix. The first differing bit is found with word XOR + clz,
+ * then A's components are scanned up to that bit. Components ending at
+ * or before the bit are shared (encoding is prefix-free, B splits into
+ * the same components there). The LCA ends where the last shared odd
+ * component ends.
+ */
+static inline status_t scan_common_prefix(
+    const codec_t *restrict codec,
+    const char *restrict a,
+    size_t abitlen,
+    const char *restrict b,
+    size_t bbitlen,
+    size_t *restrict pncomps,
+    size_t *restrict pbitlen,
+    size_t *restrict plcabitlen)
+{
+    size_t common = bits_common_prefix(a, b, MIN(abitlen, bbitlen));
+    struct scanner sc = SCANNER_INIT(a, abitlen);
+    size_t ncomps = 0, bitlen = 0, lastodd = 0;
+    uint64_t code;
+    int intind;
+
+    while (sc.pos < common && (intind = scan_next(codec, &sc, &code))) {
+        if (sc.pos > common) {
+            break;
+        }
+        ncomps++;
+        bitlen = sc.pos;
+        lastodd = IS_ODD_COMPONENT(codec, intind, code) ? sc.pos : lastodd;
+    }
+    if (__UNLIKELY(sc.pos < common)) {
+        return ORDPATH_CORRUPTDATA;
+    }
+    *pncomps = ncomps;
+    *pbitlen = bitlen;
+    *plcabitlen = lastodd;
+    return ORDPATH_SUCCESS;
+}
+
+status_t
+ordpath_common_prefix(
+    const codec_t *restrict codec,
+    const char *restrict abuf,
+    size_t abitlen,
+    const char *restrict bbuf,
+    size_t bbitlen,
+    size_t *restrict pncomps,
+    size_t *restrict pbitlen)
+{
+    size_t lcabitlen;
+    return scan_common_prefix(codec, abuf, abitlen, bbuf, bbitlen,
+            pncomps, pbitlen, &lcabitlen);
+}
+
+status_t
+ordpath_lca(
+    const codec_t *restrict codec,
+    const char *restrict abuf,
+    size_t abitlen,
+    const char *restrict bbuf,
+    size_t bbitlen,
+    size_t *restrict plcabitlen)
+{
+    size_t ncomps, bitlen;
+    return scan_common_prefix(codec, abuf, abitlen, bbuf, bbitlen,
+            &ncomps, &bitlen, plcabitlen);
+}
+
+status_t
+ordpath_lca_batch(
+    const codec_t *restrict codec,
+    size_t n,
+    const char * const abufs[],
+    const size_t abitlens[],
+    const char * const bbufs[],
+    const size_t bbitlens[],
+    size_t lcabitlens[],
+    status_t statuses[])
+{
+    status_t status = ORDPATH_SUCCESS, t;
+    size_t i, ncomps, bitlen;
+    for (i = 0; i < n; i++) {
+        t = scan_common_prefix(codec, abufs[i], abitlens[i],
+                bbufs[i], bbitlens[i], &ncomps, &bitlen, lcabitlens + i);
+        if (statuses) {
+            statuses[i] = t;
+        }
+        if (t != ORDPATH_SUCCESS && status == ORDPATH_SUCCESS) {
+            status = t;
+        }
+    }
+    return status;
+}
+
+/*
+ * Subtree bounds. Keys are encoded labels compared bytewise (padding
+ * bits are zero). X and its descendants share X's bits, the exclusive
+ * upper bound is X's bits incremented as a binary number (with carry).
+ * Trailing zero bytes are stripped from the upper bound, otherwise a
+ * shorter key that is a byte prefix of the bound would sort before it.
+ */
+static inline status_t subtree_bounds(
+    const char *restrict inbuf,
+    size_t inbitlen,
+    char *restrict lower,
+    size_t *restrict plowerbitlen,
+    char *restrict upper,
+    size_t *restrict pupperbitlen)
+{
+    size_t size = (inbitlen + CHAR_BIT - 1) / CHAR_BIT, i;
+    unsigned mask = size ?
+        (0xff00u >> (inbitlen - (size - 1) * CHAR_BIT)) & 0xff : 0;
+    unsigned carry;
+
+    if (lower) {
+        memcpy(lower, inbuf, size);
+        if (size) {
+            lower[size - 1] &= mask;
+        }
+        *plowerbitlen = inbitlen;
+    }
+
+    /* increment at the last bit; mask & -mask is the last bit weight */
+    carry = mask & -mask;
+    for (i = size; i-- > 0; ) {
+        unsigned t = ((unsigned char)inbuf[i] & (i == size - 1 ? mask : 0xff))
+            + carry;
+        upper[i] = (char)t;
+        carry = t >> CHAR_BIT;
+    }
+    if (carry || size == 0) {
+        /* all ones (or the root): no upper bound */
+        *pupperbitlen = 0;
+        return ORDPATH_SUCCESS;
+    }
+    while (upper[size - 1] == 0) {
+        size--;
+    }
+    *pupperbitlen = size * CHAR_BIT
+        - __builtin_ctz((unsigned char)upper[size - 1]);
+    return ORDPATH_SUCCESS;
+}
+
+status_t
+ordpath_subtree_bounds(
+    const codec_t *restrict codec,
+    const char *restrict inbuf,
+    size_t inbitlen,
+    char *restrict lower,
+    size_t *restrict plowerbitlen,
+    char *restrict upper,
+    size_t *restrict pupperbitlen)
+{
+    if (!codec->ordered) {
+        DEBUG("Codec doesn't preserve order");
+        return ORDPATH_INVAL;
+    }
+    return subtree_bounds(inbuf, inbitlen,
+            lower, plowerbitlen, upper, pupperbitlen);
+}
+
+status_t
+ordpath_subtree_bounds_batch(
+    const codec_t *restrict codec,
+    size_t n,
+    const char * const inbufs[],
+    const size_t inbitlens[],
+    char * const lowers[],
+    size_t lowerbitlens[],
+    char * const uppers[],
+    size_t upperbitlens[])
+{
+    size_t i;
+    if (!codec->ordered) {
+        DEBUG("Codec doesn't preserve order");
+        return ORDPATH_INVAL;
+    }
+    for (i = 0; i < n; i++) {
+        subtree_bounds(inbufs[i], inbitlens[i],
+                lowers ? lowers[i] : NULL, lowers ? lowerbitlens + i : NULL,
+                uppers[i], upperbitlens + i);
+    }
+    return ORDPATH_SUCCESS;
+}
+
+/*
+ * Columnar layout. Component i of every label is stored in column i.
+ * A column is an array of fixed width (1, 2, 4 or 8 bytes) unsigned
+ * codes, code = value - base. If a label has less than i+1 components
+ * column i holds the all-ones code (absent). The span of values in a
+ * column is always less than the all-ones code, hence an absent code
+ * never matches a filter.
+ */
+
+struct column {
+    int64_t                    base;     /* min value */
+    int64_t                    max;
+    int                        width;    /* bytes per code */
+    void                      *codes;
+};
+
+struct ordpath_columns {
+    const codec_t             *codec;
+    size_t                     n;
+    size_t                     ncolumns;
+    size_t                    *lablens;
+    struct column             *columns;
+};
+
+typedef ordpath_columns_t columns_t;
+
+#define COLUMN_ABSENT(width) \
+    ((width) == 8 ? UINT64_MAX : ((uint64_t)1 << 8*(width)) - 1)
+
+static inline uint64_t column_get(const struct column *col, size_t i)
+{
+    switch (col->width) {
+    case 1:  return ((const uint8_t *)col->codes)[i];
+    case 2:  return ((const uint16_t *)col->codes)[i];
+    case 4:  return ((const uint32_t *)col->codes)[i];
+    default: return ((const uint64_t *)col->codes)[i];
+    }
+}
+
+static inline void column_put(struct column *col, size_t i, uint64_t code)
+{
+    switch (col->width) {
+    case 1:  ((uint8_t *)col->codes)[i] = code; break;
+    case 2:  ((uint16_t *)col->codes)[i] = code; break;
+    case 4:  ((uint32_t *)col->codes)[i] = code; break;
+    default: ((uint64_t *)col->codes)[i] = code; break;
+    }
+}
+
+void
+ordpath_columns_destroy(
+    columns_t *cols)
+{
+    if (cols) {
+        for (size_t j = 0; j < cols->ncolumns; j++) {
+            free(cols->columns[j].codes);
+        }
+        free(cols->columns);
+        free(cols->lablens);
+        free(cols);
+    }
+}
+
+status_t
+ordpath_columns_create(
+    columns_t **pcols,
+    const codec_t *codec,
+    size_t n,
+    const char * const inbufs[],
+    const size_t inbitlens[])
+{
+    columns_t *cols;
+    int64_t *label = NULL;
+    size_t maxbitlen = 0, capacity = 0, i, j, len;
+    status_t status = ORDPATH_OUTOFMEM;
+
+    *pcols = NULL;
+    if (!(cols = calloc(1, sizeof *cols))
+            || !(cols->lablens = malloc(n * sizeof cols->lablens[0] + 1))) {
+        goto out;
+    }
+    cols->codec = codec;
+    cols->n = n;
+
+    for (i = 0; i < n; i++) {
+        maxbitlen = MAX(maxbitlen, inbitlens[i]);
+    }
+    /* a component takes at least 1 bit */
+    if (!(label = malloc((maxbitlen + 1) * sizeof label[0]))) {
+        goto out;
+    }
+
+    /* pass 1: label lengths and value ranges */
+    for (i = 0; i < n; i++) {
+        status = ordpath_decode(codec, inbufs[i], inbitlens[i], label, &len);
+        if (status != ORDPATH_SUCCESS) {
+            goto out;
+        }
+        status = ORDPATH_OUTOFMEM;
+        if (len > capacity) {
+            size_t newcap = MAX(len, 2 * capacity);
+            struct column *t = realloc(cols->columns, newcap * sizeof *t);
+            if (!t) {
+                goto out;
+            }
+            cols->columns = t;
+            capacity = newcap;
+        }
+        for (j = cols->ncolumns; j < len; j++) {
+            cols->columns[j].base = INT64_MAX;
+            cols->columns[j].max = INT64_MIN;
+            cols->columns[j].codes = NULL;
+        }
+        cols->ncolumns = MAX(cols->ncolumns, len);
+        for (j = 0; j < len; j++) {
+            struct column *col = cols->columns + j;
+            col->base = MIN(col->base, label[j]);
+            col->max = MAX(col->max, label[j]);
+        }
+        cols->lablens[i] = len;
+    }
+
+    /* pick the width, all columns are initially absent */
+    for (j = 0; j < cols->ncolumns; j++) {
+        struct column *col = cols->columns + j;
+        uint64_t span = (uint64_t)col->max - (uint64_t)col->base;
+        col->width = span < 0xff ? 1 : span < 0xffff ? 2 :
+            span < 0xffffffff ? 4 : 8;
+        if (!(col->codes = malloc(n * col->width + 1))) {
+            goto out;
+        }
+        memset(col->codes, 0xff, n * col->width);
+    }
+
+    /* pass 2: store codes */
+    for (i = 0; i < n; i++) {
+        status = ordpath_decode(codec, inbufs[i], inbitlens[i], label, &len);
+        if (status != ORDPATH_SUCCESS) {
+            goto out;
+        }
+        for (j = 0; j < len; j++) {
+            struct column *col = cols->columns + j;
+            column_put(col, i, (uint64_t)label[j] - (uint64_t)col->base);
+        }
+    }
+
+    *pcols = cols;
+    cols = NULL;
+    status = ORDPATH_SUCCESS;
+out:
+    free(label);
+    ordpath_columns_destroy(cols);
+    return status;
+}
+
+void
+ordpath_columns_shape(
+    const columns_t *cols,
+    size_t *pn,
+    size_t *pncolumns)
+{
+    *pn = cols->n;
+    *pncolumns = cols->ncolumns;
+}
+
+/*
+ * Filter kernels. Row i matches iff (code[i] - lo) <= d (unsigned,
+ * computed in the code width). Every kernel fills a single bitmap word
+ * (rows i..i+m-1).
+ */
+
+#define FILTER_KERNEL(type, codes, i, m, lo, d) ({                       \
+    const type *p = (const type *)(codes) + (i);                         \
+    uint64_t bits = 0;                                                   \
+    for (size_t k = 0; k < (m); k++) {                                   \
+        bits |= (uint64_t)((type)(p[k] - (type)(lo)) <= (type)(d)) << k; \
+    }                                                                    \
+    bits; })
+
+static inline uint64_t filter_portable(
+    const struct column *col,
+    size_t i,
+    size_t m,
+    uint64_t lo,
+    uint64_t d)
+{
+    switch (col->width) {
+    case 1:  return FILTER_KERNEL(uint8_t, col->codes, i, m, lo, d);
+    case 2:  return FILTER_KERNEL(uint16_t, col->codes, i, m, lo, d);
+    case 4:  return FILTER_KERNEL(uint32_t, col->codes, i, m, lo, d);
+    default: return FILTER_KERNEL(uint64_t, col->codes, i, m, lo, d);
+    }
+}
+
+#if defined(ORDPATH_SSE2_FILTER)
+
+/*
+ * SSE2 has no unsigned compares; both operands are XOR-ed with the sign
+ * bit and compared signed. Per-lane compare results are packed to bytes
+ * and collected with movemask, 16 rows at a time. 64 bit codes are
+ * handled by the portable kernel (no 64 bit compare in SSE2).
+ */
+static inline uint64_t filter_sse2(
+    const struct column *col,
+    size_t i,
+    uint64_t lo,
+    uint64_t d)
+{
+    const __m128i *p;
+    __m128i vlo, vd, gt;
+    uint64_t bits = 0;
+    int k;
+
+#define FILTER_GT(op, x) \
+    _mm_cmpgt_##op(_mm_xor_si128(_mm_sub_##op(_mm_loadu_si128(x), vlo), \
+        sign), vd)
+
+    switch (col->width) {
+    case 1: {
+        const __m128i sign = _mm_set1_epi8((char)0x80);
+        p = (const __m128i *)((const uint8_t *)col->codes + i);
+        vlo = _mm_set1_epi8((char)lo);
+        vd = _mm_xor_si128(_mm_set1_epi8((char)d), sign);
+        for (k = 0; k < 4; k++, p++) {
+            gt = FILTER_GT(epi8, p);
+            bits |= (uint64_t)(~_mm_movemask_epi8(gt) & 0xffff) << 16*k;
+        }
+        break;
+    }
+    case 2: {
+        const __m128i sign = _mm_set1_epi16((short)0x8000);
+        p = (const __m128i *)((const uint16_t *)col->codes + i);
+        vlo = _mm_set1_epi16((short)lo);
+        vd = _mm_xor_si128(_mm_set1_epi16((short)d), sign);
+        for (k = 0; k < 4; k++, p += 2) {
+            gt = _mm_packs_epi16(FILTER_GT(epi16, p), FILTER_GT(epi16, p+1));
+            bits |= (uint64_t)(~_mm_movemask_epi8(gt) & 0xffff) << 16*k;
+        }
+        break;
+    }
+    case 4: {
+        const __m128i sign = _mm_set1_epi32((int)0x80000000);
+        p = (const __m128i *)((const uint32_t *)col->codes + i);
+        vlo = _mm_set1_epi32((int)lo);
+        vd = _mm_xor_si128(_mm_set1_epi32((int)d), sign);
+        for (k = 0; k < 4; k++, p += 4) {
+            gt = _mm_packs_epi16(
+                    _mm_packs_epi32(FILTER_GT(epi32, p), FILTER_GT(epi32, p+1)),
+                    _mm_packs_epi32(FILTER_GT(epi32, p+2), FILTER_GT(epi32, p+3)));
+            bits |= (uint64_t)(~_mm_movemask_epi8(gt) & 0xffff) << 16*k;
+        }
+        break;
+    }
+    default:
+        bits = filter_portable(col, i, 64, lo, d);
+        break;
+    }
+
+#undef FILTER_GT
+
+    return bits;
+}
+
+#endif
+
+status_t
+ordpath_columns_filter(
+    const columns_t *cols,
+    size_t column,
+    int64_t min,
+    int64_t max,
+    uint64_t bitmap[])
+{
+    const struct column *col;
+    uint64_t lo, d;
+    size_t i;
+
+    if (column >= cols->ncolumns
+            || min > max
+            || min > cols->columns[column].max
+            || max < cols->columns[column].base) {
+        memset(bitmap, 0, (cols->n + 63) / 64 * sizeof bitmap[0]);
+        return ORDPATH_SUCCESS;
+    }
+
+    col = cols->columns + column;
+    lo = (uint64_t)MAX(min, col->base) - (uint64_t)col->base;
+    d = (uint64_t)MIN(max, col->max) - (uint64_t)col->base - lo;
+
+    for (i = 0; i + 64 <= cols->n; i += 64) {
+#if defined(ORDPATH_SSE2_FILTER)
+        bitmap[i / 64] = filter_sse2(col, i, lo, d);
+#else
+        bitmap[i / 64] = filter_portable(col, i, 64, lo, d);
+#endif
+    }
+    if (i < cols->n) {
+        bitmap[i / 64] = filter_portable(col, i, cols->n - i, lo, d);
+    }
+    return ORDPATH_SUCCESS;
+}
+
+status_t
+ordpath_columns_get(
+    const columns_t *cols,
+    size_t row,
+    int64_t label[],
+    size_t *plablen)
+{
+    if (row >= cols->n) {
+        DEBUG("Row %zu out of range", row);
+        return ORDPATH_INVAL;
+    }
+    for (size_t j = 0; j < cols->lablens[row]; j++) {
+        const struct column *col = cols->columns + j;
+        label[j] = (int64_t)(column_get(col, row) + (uint64_t)col->base);
+    }
+    *plablen = cols->lablens[row];
+    return ORDPATH_SUCCESS;
+}
+
+/*
+ * Components are gathered into a small local array and encoded chunk
+ * by chunk, every next chunk is appended at the bit offset where the
+ * previous one ended.
+ */
+status_t
+ordpath_columns_encode(
+    const columns_t *cols,
+    size_t row,
+    char outbuf[],
+    size_t *poutbitlen)
+{
+    int64_t chunk [64];
+    size_t lablen, bitlen = 0, j, k;
+
+    if (row >= cols->n) {
+        DEBUG("Row %zu out of range", row);
+        return ORDPATH_INVAL;
+    }
+    lablen = cols->lablens[row];
+    j = 0;
+    do {
+        size_t chunkbitlen;
+        status_t status;
+
+        for (k = 0; k < 64 && j < lablen; k++, j++) {
+            const struct column *col = cols->columns + j;
+            chunk[k] = (int64_t)(column_get(col, row) + (uint64_t)col->base);
+        }
+        status = encode_core(cols->codec, chunk, k,
+                outbuf + bitlen / CHAR_BIT, bitlen % CHAR_BIT, 0,
+                &chunkbitlen, 1, 0, 0);
+        if (status != ORDPATH_SUCCESS) {
+            return status;
+        }
+        bitlen += chunkbitlen;
+    } while (j < lablen);
+    *poutbitlen = bitlen;
+    return ORDPATH_SUCCESS;
+}
+
+
+/*
+ * Transcoder. Decoder loop (see decode_core) and encoder loop (see
+ * encode_core) fused together: a component decoded with the source
+ * codec is immediately encoded with the target codec. The input is
+ * read and the output is written in whole 64 bit words.
+ */
+static inline status_t transcode_core(
+    const codec_t *restrict from,
+    const codec_t *restrict to,
+    const char *restrict inbuf,
+    size_t inbitlen,
+    char *restrict outbuf,
+    size_t *restrict poutbitlen)
+{
+    const char *in = inbuf;
+    char *out = outbuf;
+    bitbuf_t acc, outacc;
+    int accused = 0, outaccused = 0;
+    status_t status = ORDPATH_SUCCESS;
+
+    acc = bb_zero();
+    outacc = bb_zero();
+
+    while (1) {
+        bitbuf_t c;
+        int64_t v;
+        int intind, bitlen;
+
+        /*
+         * decode a component
+         */
+        intind = from->intlookuptab[make_tab_ind(acc)];
+        bitlen = from->intervals[intind].bitlen;
+        c = acc;
+        if (__LIKELY(accused > bitlen)) {
+            accused -= bitlen;
+            acc = bb_shl(acc, bitlen);
+        } else {
+            int accused_prev = accused;
+
+            /* 64 bits availible but no valid prefix found */
+            if (__UNLIKELY(accused_prev == 64)) {
+                status = ORDPATH_CORRUPTDATA;
+                break;
+            }
+
+            /* fill acc */
+            accused = 0;
+            if (__LIKELY(inbitlen != 0)) {
+                accused = (__LIKELY(inbitlen > 64)) ? 64 : inbitlen;
+                acc = bb_load_be((const int64_t *)in);
+                in += 8;
+                inbitlen -= accused;
+            }
+
+            c = bb_or(c, bb_shr(acc, accused_prev));
+            intind = from->intlookuptab[make_tab_ind(c)];
+            bitlen = from->intervals[intind].bitlen;
+
+            /* not enough bits? */
+            if (__UNLIKELY(bitlen > accused_prev + accused)) {
+                /* do we have trailing junk? */
+                if (accused + accused_prev != 0) {
+                    status = ORDPATH_CORRUPTDATA;
+                }
+                break;
+            }
+
+            accused -= bitlen - accused_prev;
+            acc = bb_shl(acc, bitlen - accused_prev);
+        }
+        bb_store(&v, bb_sub(
+                bb_shr(c, 64 - bitlen),
+                bb_load(&from->intervals[intind].bias)));
+
+        /*
+         * encode it
+         */
+        if (__UNLIKELY(v < to->range[0] || v >= to->range[1])) {
+            status = ORDPATH_OUTOFRANGE;
+            break;
+        }
+        intind = lookup_interval(to, &v);
+        bitlen = to->intervals[intind].bitlen;
+        c = bb_shl(bb_add(bb_load(&v), bb_load(&to->intervals[intind].bias)),
+                64 - bitlen);
+        outacc = bb_or(outacc, bb_shr(c, outaccused));
+        outaccused += bitlen;
+        if (__UNLIKELY(outaccused >= 64)) {
+            bb_store_be((int64_t *)out, outacc);
+            out += 8;
+            outaccused -= 64;
+            outacc = bb_shl(c, bitlen - outaccused);
+        }
+    }
+
+    bb_store_be((int64_t *)out, outacc);
+    *poutbitlen = CHAR_BIT * (out - outbuf) + outaccused;
+    bb_cleanup();
+    return status;
+}
+
+status_t
+ordpath_transcode(
+    const codec_t *restrict from,
+    const codec_t *restrict to,
+    const char *restrict inbuf,
+    size_t inbitlen,
+    char *restrict outbuf,
+    size_t *restrict poutbitlen)
+{
+#ifndef NDEBUG
+    /*
+     * rejecting unaligned buffers
+     */
+    if (((uintptr_t)inbuf | (uintptr_t)outbuf)
+            & (ORDPATH_BUF_ALIGNMENT - 1)) {
+        DEBUG("Unaligned buffer, expected alignment %d",
+            ORDPATH_BUF_ALIGNMENT);
+        return ORDPATH_INVAL;
+    }
+#endif
+
+    return transcode_core(from, to, inbuf, inbitlen, outbuf, poutbitlen);
+}
+
+status_t
+ordpath_transcode_batch(
+    const codec_t *restrict from,
+    const codec_t *restrict to,
+    size_t n,
+    const char * const inbufs[],
+    const size_t inbitlens[],
+    char * const outbufs[],
+    size_t outbitlens[],
+    status_t statuses[])
+{
+    status_t status = ORDPATH_SUCCESS, t;
+    size_t i;
+    for (i = 0; i < n; i++) {
+        t = ordpath_transcode(from, to, inbufs[i], inbitlens[i],
+                outbufs[i], outbitlens + i);
+        if (statuses) {
+            statuses[i] = t;
+        }
+        if (t != ORDPATH_SUCCESS && status == ORDPATH_SUCCESS) {
+            status = t;
+        }
+    }
+    return status;
+}
+
+/*
+ * Bulk transcoder. The batch is split into contiguous ranges, one per
+ * thread. The calling thread takes the first range. If a thread fails
+ * to start, its range is processed by the calling thread.
+ */
+
+#define BULK_THREADS_MAX       64
+#define BULK_LABELS_MIN        4096  /* per thread */
+
+struct bulkjob {
+    const codec_t             *from;
+    const codec_t             *to;
+    size_t                     n;
+    const char * const        *inbufs;
+    const size_t              *inbitlens;
+    char * const              *outbufs;
+    size_t                    *outbitlens;
+    status_t                  *statuses;
+    status_t                   status;
+    pthread_t                  thread;
+    int                        started;
+};
+
+static void *bulk_worker(void *arg)
+{
+    struct bulkjob *job = arg;
+    job->status = ordpath_transcode_batch(job->from, job->to, job->n,
+            job->inbufs, job->inbitlens, job->outbufs, job->outbitlens,
+            job->statuses);
+    return NULL;
+}
+
+status_t
+ordpath_transcode_bulk(
+    const codec_t *restrict from,
+    const codec_t *restrict to,
+    size_t n,
+    const char * const inbufs[],
+    const size_t inbitlens[],
+    char * const outbufs[],
+    size_t outbitlens[],
+    status_t statuses[],
+    int nthreads)
+{
+    struct bulkjob jobs [BULK_THREADS_MAX];
+    size_t chunk, pos = 0;
+    int i;
+
+    if (nthreads <= 0) {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = ncpu > 0 ? (int)ncpu : 1;
+    }
+    nthreads = MIN(nthreads, BULK_THREADS_MAX);
+    nthreads = MIN((size_t)nthreads, n / BULK_LABELS_MIN + 1);
+    chunk = (n + nthreads - 1) / nthreads;
+
+    for (i = 0; i < nthreads; i++) {
+        struct bulkjob *job = jobs + i;
+        job->from = from;
+        job->to = to;
+        job->n = MIN(chunk, n - pos);
+        job->inbufs = inbufs + pos;
+        job->inbitlens = inbitlens + pos;
+        job->outbufs = outbufs + pos;
+        job->outbitlens = outbitlens + pos;
+        job->statuses = statuses ? statuses + pos : NULL;
+        job->started = i != 0
+            && pthread_create(&job->thread, NULL, bulk_worker, job) == 0;
+        pos += job->n;
+    }
+
+    for (i = 0; i < nthreads; i++) {
+        if (jobs[i].started) {
+            pthread_join(jobs[i].thread, NULL);
+        } else {
+            bulk_worker(jobs + i);
+        }
+    }
+
+    /* the status of the first failed label */
+    for (i = 0; i < nthreads; i++) {
+        if (jobs[i].status != ORDPATH_SUCCESS) {
+            return jobs[i].status;
+        }
+    }
+    return ORDPATH_SUCCESS;
+}
+
+
+/*
+ * Parallel decoder for long labels. The label is split into chunks of
+ * equal bit length, one per thread. Component boundaries within a chunk
+ * are unknown until the previous chunk is decoded, hence chunks (except
+ * the first one) are decoded speculatively starting at the chunk's
+ * first bit (further candidates are tried if that leads to invalid
+ * data). Prefix codes resynchronize quickly: a speculative decode
+ * usually hits a true component boundary after a few components. The
+ * starts of the first SPAN_BOUNDS components are recorded.
+ *
+ * Chunks are stitched serially. The true entry of a chunk is where the
+ * previous chunk's last component ends; the chunk is scanned from the
+ * entry up to the first recorded boundary (sync point). Components past
+ * the sync point are taken from the speculative decode, components
+ * before it are decoded again. If there is no sync point, the chunk is
+ * decoded serially.
+ *
+ * A span decodes components starting in [start, stop). Speculative
+ * output goes to a scratch array (sized for the shortest component),
+ * the label array is written with true components only hence its
+ * capacity requirements are the same as in ordpath_decode().
+ */
+
+#define PARALLEL_BITS_MIN      8192  /* per chunk */
+#define PARALLEL_CANDIDATES    8
+#define SPAN_BOUNDS            32
+
+struct span {
+    size_t                     start;
+    size_t                     stop;
+    size_t                     n;       /* components */
+    size_t                     end;     /* where the last one ends */
+    size_t                     nbounds;
+    size_t                     bounds [SPAN_BOUNDS];
+};
+
+/*
+ * Decode a span. If *syncwith* is non-NULL, stops at the first
+ * component starting at any of syncwith->bounds (the index is stored
+ * in *psync, SIZE_MAX if none). If *skip* is set, nothing is stored.
+ * Regular decoder loop otherwise (see decode_core()); input is read
+ * bytewise at the label end.
+ */
+static inline status_t decode_span(
+    const codec_t *restrict codec,
+    const char *restrict inbuf,
+    size_t inbitlen,
+    struct span *restrict sp,
+    int64_t *restrict label,
+    const struct span *restrict syncwith,
+    size_t *restrict psync,
+    const int skip)
+{
+    const char *in = inbuf + sp->start / CHAR_BIT;
+    int bitoff = sp->start % CHAR_BIT;
+    size_t pos = sp->start, end = MIN(sp->stop, inbitlen), n = 0, js = 0;
+    size_t avail = inbitlen - sp->start + bitoff;
+    bitbuf_t acc, c;
+    int accused, accused_prev, bitlen, intind;
+
+    accused = MIN(avail, 64);
+    acc = bb_shl(bb_loadu_be(in, (accused + CHAR_BIT - 1) / CHAR_BIT),
+            bitoff);
+    in += 8;
+    avail -= accused;
+    accused -= bitoff;
+
+    sp->nbounds = 0;
+    while (pos < end) {
+        if (syncwith) {
+            while (js < syncwith->nbounds && syncwith->bounds[js] < pos) {
+                js++;
+            }
+            if (js < syncwith->nbounds && syncwith->bounds[js] == pos) {
+                break;
+            }
+        }
+        if (!syncwith && sp->nbounds < SPAN_BOUNDS) {
+            sp->bounds[sp->nbounds++] = pos;
+        }
+
+        intind = codec->intlookuptab[make_tab_ind(acc)];
+        bitlen = codec->intervals[intind].bitlen;
+        if (__LIKELY(accused > bitlen)) {
+            c = acc;
+            accused -= bitlen;
+            acc = bb_shl(acc, bitlen);
+        } else {
+            /* 64 bits availible but no valid prefix found */
+            if (__UNLIKELY(accused == 64)) {
+                bb_cleanup();
+                return ORDPATH_CORRUPTDATA;
+            }
+
+            c = acc;
+            accused_prev = accused;
+            accused = 0;
+            if (__LIKELY(avail != 0)) {
+                accused = (__LIKELY(avail > 64)) ? 64 : avail;
+                acc = bb_loadu_be(in, (accused + CHAR_BIT - 1) / CHAR_BIT);
+                in += 8;
+                avail -= accused;
+            }
+            c = bb_or(c, bb_shr(acc, accused_prev));
+            intind = codec->intlookuptab[make_tab_ind(c)];
+            bitlen = codec->intervals[intind].bitlen;
+            if (__UNLIKELY(bitlen > accused_prev + accused)) {
+                bb_cleanup();
+                return ORDPATH_CORRUPTDATA;
+            }
+            accused -= bitlen - accused_prev;
+            acc = bb_shl(acc, bitlen - accused_prev);
+        }
+        if (!skip) {
+            bb_store(label + n, bb_sub(
+                    bb_shr(c, 64 - bitlen),
+                    bb_load(&codec->intervals[intind].bias)));
+        }
+        n++;
+        pos += bitlen;
+    }
+    if (syncwith) {
+        *psync = pos < end ? js : SIZE_MAX;
+    }
+    sp->n = n;
+    sp->end = pos;
+    bb_cleanup();
+    return ORDPATH_SUCCESS;
+}
+
+struct specjob {
+    const codec_t             *codec;
+    const char                *inbuf;
+    size_t                     inbitlen;
+    int64_t                   *scratch;
+    size_t                     begin;
+    struct span                span;
+    status_t                   status;
+    pthread_t                  thread;
+    int                        started;
+};
+
+static void *spec_worker(void *arg)
+{
+    struct specjob *job = arg;
+    for (int d = 0; d < PARALLEL_CANDIDATES; d++) {
+        job->span.start = job->begin + d;
+        if (job->span.start >= job->span.stop) {
+            break;
+        }
+        job->status = decode_span(job->codec, job->inbuf, job->inbitlen,
+                &job->span, job->scratch, NULL, NULL, 0);
+        if (job->status == ORDPATH_SUCCESS) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+status_t
+ordpath_decode_parallel(
+    const codec_t *restrict codec,
+    const char *restrict inbuf,
+    size_t inbitlen,
+    int64_t *restrict label,
+    size_t *restrict plablen,
+    int nthreads)
+{
+    struct specjob jobs [BULK_THREADS_MAX];
+    struct span sp;
+    size_t chunk, scratchsize, out, sync;
+    int64_t *scratch = NULL;
+    status_t status = ORDPATH_SUCCESS;
+    int i;
+
+#ifndef NDEBUG
+    if ((uintptr_t)inbuf & (ORDPATH_BUF_ALIGNMENT - 1)) {
+        DEBUG("Unaligned buffer, expected alignment %d",
+            ORDPATH_BUF_ALIGNMENT);
+        return ORDPATH_INVAL;
+    }
+#endif
+
+    if (nthreads <= 0) {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = ncpu > 0 ? (int)ncpu : 1;
+    }
+    nthreads = MIN(nthreads, BULK_THREADS_MAX);
+    nthreads = MIN((size_t)nthreads, inbitlen / PARALLEL_BITS_MIN);
+    if (nthreads <= 1) {
+        status = decode_core(codec, inbuf, 0, inbitlen, label, plablen, 0);
+        goto out;
+    }
+    chunk = (inbitlen + nthreads - 1) / nthreads;
+    scratchsize = chunk / codec->minbitlen + 1;
+
+    /* decoding serially is better than failing */
+    if (!(scratch = malloc((nthreads - 1) * scratchsize
+                    * sizeof scratch[0]))) {
+        status = decode_core(codec, inbuf, 0, inbitlen, label, plablen, 0);
+        goto out;
+    }
+
+    for (i = 0; i < nthreads; i++) {
+        struct specjob *job = jobs + i;
+        job->codec = codec;
+        job->inbuf = inbuf;
+        job->inbitlen = inbitlen;
+        job->scratch = i ? scratch + (i - 1) * scratchsize : NULL;
+        job->begin = i * chunk;
+        job->span.stop = MIN((i + 1) * chunk, inbitlen);
+        job->status = ORDPATH_CORRUPTDATA;
+        job->started = i != 0
+            && pthread_create(&job->thread, NULL, spec_worker, job) == 0;
+    }
+
+    /* the first chunk is decoded for real */
+    jobs[0].span.start = 0;
+    status = decode_span(codec, inbuf, inbitlen, &jobs[0].span, label,
+            NULL, NULL, 0);
+    for (i = 1; i < nthreads; i++) {
+        if (jobs[i].started) {
+            pthread_join(jobs[i].thread, NULL);
+        } else {
+            spec_worker(jobs + i);
+        }
+    }
+    if (status != ORDPATH_SUCCESS) {
+        goto out;
+    }
+
+    /* stitch */
+    out = jobs[0].span.n;
+    for (i = 1; i < nthreads; i++) {
+        struct specjob *job = jobs + i;
+        size_t entry = jobs[i - 1].span.end;
+
+        sp.start = entry;
+        sp.stop = job->span.stop;
+        sync = SIZE_MAX;
+        if (job->status == ORDPATH_SUCCESS) {
+            status = decode_span(codec, inbuf, inbitlen, &sp, NULL,
+                    &job->span, &sync, 1);
+            if (status != ORDPATH_SUCCESS) {
+                goto out;
+            }
+        }
+        if (sync != SIZE_MAX) {
+            size_t syncpos = job->span.bounds[sync], n;
+            status = decode_core(codec, inbuf + entry / CHAR_BIT,
+                    entry % CHAR_BIT, syncpos - entry, label + out, &n, 1);
+            if (status != ORDPATH_SUCCESS) {
+                goto out;
+            }
+            out += n;
+            memcpy(label + out, job->scratch + sync,
+                    (job->span.n - sync) * sizeof label[0]);
+            out += job->span.n - sync;
+        } else {
+            /* no sync point, serial fallback */
+            status = decode_span(codec, inbuf, inbitlen, &sp, label + out,
+                    NULL, NULL, 0);
+            if (status != ORDPATH_SUCCESS) {
+                goto out;
+            }
+            job->span.end = sp.end;
+            out += sp.n;
+        }
+    }
+    *plablen = out;
+out:
+    if (status != ORDPATH_SUCCESS) {
+        *plablen = 0;
+    }
+    free(scratch);
+    return status;
+}
+
+
+
+
+/*
+ * Codec family. Every label is encoded with the member producing the
+ * shortest encoding and is prefixed with the member's index (tag,
+ * ceil(log2(n)) bits). The encoded label proper starts at the tag's
+ * end within the first byte, hence the regular encoder and decoder
+ * loops are used as is (see encode_core()/decode_core() bitoff).
+ */
+
+struct ordpath_family {
+    int                        n;
+    int                        tagbits;
+    codec_t                   *codecs [ORDPATH_FAMILY_MAX];
+};
+
+typedef ordpath_family_t family_t;
+
+void
+ordpath_family_destroy(
+    family_t *family)
+{
+    if (family) {
+        for (int i = 0; i < family->n; i++) {
+            ordpath_destroy(family->codecs[i]);
+        }
+        free(family);
+    }
+}
+
+status_t
+ordpath_family_create(
+    family_t **pfamily,
+    const char * const setupstrs[],
+    size_t n)
+{
+    family_t *family;
+    status_t status = ORDPATH_SUCCESS;
+
+    *pfamily = NULL;
+    if (n == 0 || n > ORDPATH_FAMILY_MAX) {
+        DEBUG("Family size must be 1..%d", ORDPATH_FAMILY_MAX);
+        return ORDPATH_INVAL;
+    }
+    if (!(family = calloc(1, sizeof *family))) {
+        return ORDPATH_OUTOFMEM;
+    }
+    while ((size_t)1 << family->tagbits < n) {
+        family->tagbits++;
+    }
+    for (; (size_t)family->n < n; family->n++) {
+        status = ordpath_create(family->codecs + family->n,
+                setupstrs[family->n], NULL);
+        if (status != ORDPATH_SUCCESS) {
+            ordpath_family_destroy(family);
+            return status;
+        }
+    }
+    *pfamily = family;
+    return status;
+}
+
+/*
+ * Encoded bit length, SIZE_MAX if some component is out of range.
+ */
+static inline size_t family_bitlen(
+    const codec_t *restrict codec,
+    const int64_t *restrict label,
+    size_t lablen)
+{
+    size_t bitlen = 0;
+    for (size_t i = 0; i < lablen; i++) {
+        if (label[i] < codec->range[0] || label[i] >= codec->range[1]) {
+            return SIZE_MAX;
+        }
+        bitlen += codec->intervals[lookup_interval(codec, label + i)].bitlen;
+    }
+    return bitlen;
+}
+
+status_t
+ordpath_family_encode(
+    const family_t *restrict family,
+    const int64_t *restrict label,
+    size_t lablen,
+    char *restrict outbuf,
+    size_t *restrict poutbitlen)
+{
+    size_t bitlen, best = SIZE_MAX;
+    int tag = 0;
+
+#ifndef NDEBUG
+    if ((uintptr_t)outbuf & (ORDPATH_BUF_ALIGNMENT - 1)) {
+        DEBUG("Unaligned buffer, expected alignment %d",
+            ORDPATH_BUF_ALIGNMENT);
+        return ORDPATH_INVAL;
+    }
+#endif
+
+    for (int i = 0; i < family->n; i++) {
+        bitlen = family_bitlen(family->codecs[i], label, lablen);
+        if (bitlen < best) {
+            best = bitlen;
+            tag = i;
+        }
+    }
+    if (best == SIZE_MAX) {
+        return ORDPATH_OUTOFRANGE;
+    }
+
+    outbuf[0] = family->tagbits ? tag << (CHAR_BIT - family->tagbits) : 0;
+    encode_core(family->codecs[tag], label, lablen, outbuf,
+            family->tagbits, 0, &bitlen, 0, 0, 0);
+    *poutbitlen = family->tagbits + bitlen;
+    return ORDPATH_SUCCESS;
+}
+
+static inline status_t family_tag(
+    const family_t *restrict family,
+    const char *restrict inbuf,
+    size_t inbitlen,
+    int *restrict ptag)
+{
+    int tag = 0;
+    if (family->tagbits) {
+        if (inbitlen < (size_t)family->tagbits) {
+            return ORDPATH_CORRUPTDATA;
+        }
+        tag = (unsigned char)inbuf[0] >> (CHAR_BIT - family->tagbits);
+    }
+    if (tag >= family->n) {
+        return ORDPATH_CORRUPTDATA;
+    }
+    *ptag = tag;
+    return ORDPATH_SUCCESS;
+}
+
+status_t
+ordpath_family_decode(
+    const family_t *restrict family,
+    const char *restrict inbuf,
+    size_t inbitlen,
+    int64_t *restrict label,
+    size_t *restrict plablen)
+{
+    status_t status;
+    int tag;
+
+#ifndef NDEBUG
+    if ((uintptr_t)inbuf & (ORDPATH_BUF_ALIGNMENT - 1)) {
+        DEBUG("Unaligned buffer, expected alignment %d",
+            ORDPATH_BUF_ALIGNMENT);
+        return ORDPATH_INVAL;
+    }
+#endif
+
+    if (ORDPATH_SUCCESS != (status = family_tag(family,
+                    inbuf, inbitlen, &tag))) {
+        return status;
+    }
+    return decode_core(family->codecs[tag], inbuf, family->tagbits,
+            inbitlen - family->tagbits, label, plablen, 0);
+}
+
+/*
+ * Scanner starting at *bitoff* bit of inbuf[0] (bitoff < 8); pos
+ * counts bits past bitoff.
+ */
+static inline void scanner_init_at(
+    struct scanner *restrict sc,
+    const char *restrict inbuf,
+    int bitoff,
+    size_t inbitlen)
+{
+    sc->in = inbuf + 8;
+    sc->accused = MIN(inbitlen + bitoff, 64) - bitoff;
+    sc->inbitlen = inbitlen - sc->accused;
+    sc->acc = load_be64(inbuf) << bitoff;
+    sc->pos = 0;
+}
+
+/*
+ * Document order: components are compared by value left to right, the
+ * first difference decides; if one label is a prefix of the other, the
+ * prefix (an ancestor) sorts first. Labels encoded with the same member
+ * of an ordered codec compare bitwise (the tag is the same). Otherwise
+ * both labels are scanned in lockstep, nothing is decoded into memory.
+ */
+status_t
+ordpath_family_compare(
+    const family_t *restrict family,
+    const char *restrict a,
+    size_t abitlen,
+    const char *restrict b,
+    size_t bbitlen,
+    int *restrict presult)
+{
+    const codec_t *ca, *cb;
+    struct scanner sa, sb;
+    uint64_t codea = 0, codeb = 0;
+    int taga, tagb, ia, ib, tagbits = family->tagbits;
+    status_t status;
+
+    if (ORDPATH_SUCCESS != (status = family_tag(family,
+                    a, abitlen, &taga))
+            || ORDPATH_SUCCESS != (status = family_tag(family,
+                    b, bbitlen, &tagb))) {
+        return status;
+    }
+    ca = family->codecs[taga];
+    cb = family->codecs[tagb];
+    if (taga == tagb && ca->ordered) {
+        *presult = bits_cmp(a, abitlen, b, bbitlen);
+        return ORDPATH_SUCCESS;
+    }
+
+    scanner_init_at(&sa, a, tagbits, abitlen - tagbits);
+    scanner_init_at(&sb, b, tagbits, bbitlen - tagbits);
+    while (1) {
+        ia = scan_next(ca, &sa, &codea);
+        ib = scan_next(cb, &sb, &codeb);
+        if (!ia || !ib) {
+            break;
+        }
+        codea -= (uint64_t)ca->intervals[ia].bias;
+        codeb -= (uint64_t)cb->intervals[ib].bias;
+        if (codea != codeb) {
+            *presult = (int64_t)codea < (int64_t)codeb ? -1 : 1;
+            return ORDPATH_SUCCESS;
+        }
+    }
+    if ((!ia && sa.pos != abitlen - tagbits)
+            || (!ib && sb.pos != bbitlen - tagbits)) {
+        return ORDPATH_CORRUPTDATA;
+    }
+    /* a prefix precedes longer labels */
+    *presult = (ia != 0) - (ib != 0);
+    return ORDPATH_SUCCESS;
+}
+
+
+
+
+/*
+ * Label trie. Interned labels form a tree, a node holds the last
+ * component of a label and links to the parent, the first child and
+ * the next sibling (32 bit node indices). Siblings are kept sorted by
+ * component, i.e. in document order. Nodes live in a single array
+ * (arena) growing by doubling. Removed nodes are unlinked and marked
+ * dead; the slots are reclaimed by compaction only, hence node indices
+ * are stable until then.
+ */
+
+#define TRIE_NONE              UINT32_MAX
+#define TRIE_DEAD              UINT32_MAX  /* depth of a removed node */
+#define TRIE_NODES_MAX         ((size_t)UINT32_MAX)
+#define TRIE_CAPACITY_MIN      64
+
+#define TRIE_ID(x) ((x) == TRIE_NONE ? ORDPATH_TRIE_NONE : (size_t)(x))
+
+struct trienode {
+    int64_t                    component;
+    uint32_t                   parent;
+    uint32_t                   child;     /* first */
+    uint32_t                   sibling;   /* next */
+    uint32_t                   depth;
+};
+
+struct ordpath_trie {
+    const codec_t             *codec;
+    size_t                     n;         /* slots in use */
+    size_t                     nlive;
+    size_t                     capacity;
+    struct trienode           *nodes;
+};
+
+typedef ordpath_trie_t trie_t;
+
+static inline int trie_valid(const trie_t *trie, size_t node)
+{
+    return node < trie->n && trie->nodes[node].depth != TRIE_DEAD;
+}
+
+static inline uint32_t trie_alloc(trie_t *trie)
+{
+    if (__UNLIKELY(trie->n == trie->capacity)) {
+        size_t capacity = MIN(2 * trie->capacity, TRIE_NODES_MAX);
+        struct trienode *t;
+        if (trie->n == capacity) {
+            DEBUG("Too many nodes");
+            return TRIE_NONE;
+        }
+        if (!(t = realloc(trie->nodes, capacity * sizeof *t))) {
+            return TRIE_NONE;
+        }
+        trie->nodes = t;
+        trie->capacity = capacity;
+    }
+    trie->nlive++;
+    return trie->n++;
+}
+
+/* unlink the node from the parent's list of children */
+static void trie_unlink(trie_t *trie, uint32_t node)
+{
+    struct trienode *nodes = trie->nodes;
+    uint32_t *link = &nodes[nodes[node].parent].child;
+    while (*link != node) {
+        link = &nodes[*link].sibling;
+    }
+    *link = nodes[node].sibling;
+}
+
+/*
+ * Find the child of the *parent* holding the *component*, the child is
+ * created if missing. Siblings are scanned starting at the *hint* (if
+ * it is a child with a smaller component) or at the first child.
+ */
+static inline uint32_t trie_child(
+    trie_t *trie,
+    uint32_t parent,
+    int64_t component,
+    uint32_t hint)
+{
+    struct trienode *nodes = trie->nodes;
+    uint32_t prev = TRIE_NONE, i = nodes[parent].child, n;
+
+    if (hint != TRIE_NONE && nodes[hint].component < component) {
+        prev = hint;
+        i = nodes[hint].sibling;
+    }
+    for (; i != TRIE_NONE && nodes[i].component < component;
+            i = nodes[i].sibling) {
+        prev = i;
+    }
+    if (i != TRIE_NONE && nodes[i].component == component) {
+        return i;
+    }
+    if ((n = trie_alloc(trie)) == TRIE_NONE) {
+        return TRIE_NONE;
+    }
+    nodes = trie->nodes;
+    nodes[n].component = component;
+    nodes[n].parent = parent;
+    nodes[n].child = TRIE_NONE;
+    nodes[n].sibling = i;
+    nodes[n].depth = nodes[parent].depth + 1;
+    if (prev == TRIE_NONE) {
+        nodes[parent].child = n;
+    } else {
+        nodes[prev].sibling = n;
+    }
+    return n;
+}
+
+/*
+ * Intern an encoded label. If *path* is non-NULL, it holds the nodes of
+ * the label interned previously (path[d] is the node at depth d,
+ * *ppathlen* entries) and is updated. The common prefix is taken from
+ * the path and the previous label's node at the first differing depth
+ * is the hint, hence labels coming in document order take O(1) per
+ * component. On failure the nodes created are removed.
+ */
+static status_t trie_insert(
+    trie_t *restrict trie,
+    const char *restrict inbuf,
+    size_t inbitlen,
+    uint32_t *restrict path,
+    size_t *restrict ppathlen,
+    uint32_t *restrict pnode)
+{
+    const codec_t *codec = trie->codec;
+    struct scanner sc = SCANNER_INIT(inbuf, inbitlen);
+    size_t n0 = trie->n, pathlen = path ? *ppathlen : 0, depth = 0;
+    uint32_t node = ORDPATH_TRIE_ROOT, hint = TRIE_NONE, first = TRIE_NONE;
+    uint64_t code;
+    int intind, same = 1;
+    status_t status = ORDPATH_SUCCESS;
+
+    while ((intind = scan_next(codec, &sc, &code))) {
+        int64_t component = (int64_t)(
+                code - (uint64_t)codec->intervals[intind].bias);
+        depth++;
+        if (same) {
+            hint = depth < pathlen ? path[depth] : TRIE_NONE;
+            if (hint != TRIE_NONE
+                    && trie->nodes[hint].component == component) {
+                node = hint;
+                continue;
+            }
+            same = 0;
+        }
+        node = trie_child(trie, node, component, hint);
+        hint = TRIE_NONE;
+        if (node == TRIE_NONE) {
+            status = ORDPATH_OUTOFMEM;
+            goto out;
+        }
+        if (first == TRIE_NONE && node >= n0) {
+            first = node;
+        }
+        if (path) {
+            path[depth] = node;
+        }
+    }
+    if (__UNLIKELY(sc.pos != inbitlen)) {
+        status = ORDPATH_CORRUPTDATA;
+        goto out;
+    }
+    if (path) {
+        *ppathlen = depth + 1;
+    }
+    *pnode = node;
+    return ORDPATH_SUCCESS;
+out:
+    /* nodes created form a chain starting at the first one */
+    if (first != TRIE_NONE) {
+        trie_unlink(trie, first);
+        trie->nlive -= trie->n - n0;
+        trie->n = n0;
+    }
+    if (path) {
+        *ppathlen = 1;
+    }
+    return status;
+}
+
+void
+ordpath_trie_destroy(
+    trie_t *trie)
+{
+    if (trie) {
+        free(trie->nodes);
+        free(trie);
+    }
+}
+
+status_t
+ordpath_trie_create(
+    trie_t **ptrie,
+    const codec_t *codec,
+    size_t n,
+    const char * const inbufs[],
+    const size_t inbitlens[],
+    size_t nodes[])
+{
+    trie_t *trie;
+    uint32_t *path = NULL, node;
+    size_t maxbitlen = 0, pathlen = 1, i;
+    status_t status = ORDPATH_OUTOFMEM;
+
+    *ptrie = NULL;
+    if (!(trie = calloc(1, sizeof *trie))
+            || !(trie->nodes = malloc(TRIE_CAPACITY_MIN
+                    * sizeof trie->nodes[0]))) {
+        goto out;
+    }
+    trie->codec = codec;
+    trie->capacity = TRIE_CAPACITY_MIN;
+    trie->n = trie->nlive = 1;
+    trie->nodes[0].component = 0;
+    trie->nodes[0].parent = TRIE_NONE;
+    trie->nodes[0].child = TRIE_NONE;
+    trie->nodes[0].sibling = TRIE_NONE;
+    trie->nodes[0].depth = 0;
+
+    for (i = 0; i < n; i++) {
+        maxbitlen = MAX(maxbitlen, inbitlens[i]);
+    }
+    if (!(path = malloc((maxbitlen / codec->minbitlen + 1)
+                    * sizeof path[0]))) {
+        goto out;
+    }
+    path[0] = ORDPATH_TRIE_ROOT;
+    for (i = 0; i < n; i++) {
+        status = trie_insert(trie, inbufs[i], inbitlens[i],
+                path, &pathlen, &node);
+        if (status != ORDPATH_SUCCESS) {
+            goto out;
+        }
+        if (nodes) {
+            nodes[i] = node;
+        }
+    }
+
+    *ptrie = trie;
+    trie = NULL;
+    status = ORDPATH_SUCCESS;
+out:
+    free(path);
+    ordpath_trie_destroy(trie);
+    return status;
+}
+
+status_t
+ordpath_trie_intern(
+    trie_t *trie,
+    const char inbuf[],
+    size_t inbitlen,
+    size_t *pnode)
+{
+    uint32_t node;
+    status_t status = trie_insert(trie, inbuf, inbitlen, NULL, NULL, &node);
+    if (status == ORDPATH_SUCCESS) {
+        *pnode = node;
+    }
+    return status;
+}
+
+status_t
+ordpath_trie_remove(
+    trie_t *trie,
+    size_t node)
+{
+    struct trienode *nodes = trie->nodes;
+    uint32_t p = node;
+
+    if (node == ORDPATH_TRIE_ROOT || !trie_valid(trie, node)) {
+        DEBUG("Node %zu can't be removed", node);
+        return ORDPATH_INVAL;
+    }
+    trie_unlink(trie, p);
+
+    /* mark the subtree dead, preorder */
+    while (1) {
+        nodes[p].depth = TRIE_DEAD;
+        trie->nlive--;
+        if (nodes[p].child != TRIE_NONE) {
+            p = nodes[p].child;
+            continue;
+        }
+        while (p != node && nodes[p].sibling == TRIE_NONE) {
+            p = nodes[p].parent;
+        }
+        if (p == node) {
+            break;
+        }
+        p = nodes[p].sibling;
+    }
+    return ORDPATH_SUCCESS;
+}
+
+/*
+ * Live nodes are renumbered in preorder (document order, children
+ * follow the parent) and moved to a new array of the exact size.
+ */
+status_t
+ordpath_trie_compact(
+    trie_t *trie,
+    size_t remap[])
+{
+    const struct trienode *old = trie->nodes;
+    struct trienode *nodes;
+    size_t capacity = trie->nlive, i;
+    uint32_t *map, p = ORDPATH_TRIE_ROOT, out = 0;
+
+#define TRIE_MAP(x) ((x) == TRIE_NONE ? TRIE_NONE : map[x])
+
+    map = malloc(trie->n * sizeof map[0]);
+    nodes = malloc(capacity * sizeof nodes[0]);
+    if (!map || !nodes) {
+        free(map);
+        free(nodes);
+        return ORDPATH_OUTOFMEM;
+    }
+    for (i = 0; i < trie->n; i++) {
+        map[i] = TRIE_NONE;
+    }
+    while (1) {
+        map[p] = out++;
+        if (old[p].child != TRIE_NONE) {
+            p = old[p].child;
+            continue;
+        }
+        while (p != ORDPATH_TRIE_ROOT && old[p].sibling == TRIE_NONE) {
+            p = old[p].parent;
+        }
+        if (p == ORDPATH_TRIE_ROOT) {
+            break;
+        }
+        p = old[p].sibling;
+    }
+    for (i = 0; i < trie->n; i++) {
+        if (map[i] != TRIE_NONE) {
+            struct trienode *t = nodes + map[i];
+            t->component = old[i].component;
+            t->parent = TRIE_MAP(old[i].parent);
+            t->child = TRIE_MAP(old[i].child);
+            t->sibling = TRIE_MAP(old[i].sibling);
+            t->depth = old[i].depth;
+        }
+        if (remap) {
+            remap[i] = TRIE_ID(map[i]);
+        }
+    }
+
+#undef TRIE_MAP
+
+    free(map);
+    free(trie->nodes);
+    trie->nodes = nodes;
+    trie->n = trie->nlive;
+    trie->capacity = capacity;
+    return ORDPATH_SUCCESS;
+}
+
+void
+ordpath_trie_shape(
+    const trie_t *trie,
+    size_t *pnnodes,
+    size_t *pnlive,
+    size_t *pbytes)
+{
+    *pnnodes = trie->n;
+    *pnlive = trie->nlive;
+    *pbytes = sizeof *trie + trie->capacity * sizeof trie->nodes[0];
+}
+
+/* removed and out of range nodes have no links */
+size_t
+ordpath_trie_parent(
+    const trie_t *trie,
+    size_t node)
+{
+    return trie_valid(trie, node) ?
+        TRIE_ID(trie->nodes[node].parent) : ORDPATH_TRIE_NONE;
+}
+
+size_t
+ordpath_trie_first_child(
+    const trie_t *trie,
+    size_t node)
+{
+    return trie_valid(trie, node) ?
+        TRIE_ID(trie->nodes[node].child) : ORDPATH_TRIE_NONE;
+}
+
+size_t
+ordpath_trie_next_sibling(
+    const trie_t *trie,
+    size_t node)
+{
+    return trie_valid(trie, node) ?
+        TRIE_ID(trie->nodes[node].sibling) : ORDPATH_TRIE_NONE;
+}
+
+size_t
+ordpath_trie_depth(
+    const trie_t *trie,
+    size_t node)
+{
+    return trie_valid(trie, node) ?
+        trie->nodes[node].depth : ORDPATH_TRIE_NONE;
+}
+
+status_t
+ordpath_trie_component(
+    const trie_t *trie,
+    size_t node,
+    int64_t *restrict pcomponent)
+{
+    if (!trie_valid(trie, node)) {
+        return ORDPATH_INVAL;
+    }
+    *pcomponent = trie->nodes[node].component;
+    return ORDPATH_SUCCESS;
+}
+
+status_t
+ordpath_trie_label(
+    const trie_t *trie,
+    size_t node,
+    int64_t label[],
+    size_t *plablen)
+{
+    const struct trienode *nodes = trie->nodes;
+    size_t depth;
+
+    if (!trie_valid(trie, node)) {
+        DEBUG("Node %zu is invalid", node);
+        return ORDPATH_INVAL;
+    }
+    depth = nodes[node].depth;
+    for (size_t j = depth; j > 0; j--) {
+        label[j - 1] = nodes[node].component;
+        node = nodes[node].parent;
+    }
+    *plablen = depth;
+    return ORDPATH_SUCCESS;
+}
+
+/*
+ * Components are gathered into a small local array and encoded chunk
+ * by chunk (see ordpath_columns_encode()). A chunk is collected walking
+ * up from its last node, reached from the label's node; labels deeper
+ * than a chunk take a quadratic number of steps.
+ */
+status_t
+ordpath_trie_encode(
+    const trie_t *trie,
+    size_t node,
+    char outbuf[],
+    size_t *poutbitlen)
+{
+    const struct trienode *nodes = trie->nodes;
+    int64_t chunk [64];
+    size_t depth, bitlen = 0, j = 0, k, d;
+
+    if (!trie_valid(trie, node)) {
+        DEBUG("Node %zu is invalid", node);
+        return ORDPATH_INVAL;
+    }
+    depth = nodes[node].depth;
+    do {
+        size_t chunkbitlen;
+        uint32_t p = node;
+        status_t status;
+
+        k = MIN(64, depth - j);
+        for (d = depth; d > j + k; d--) {
+            p = nodes[p].parent;
+        }
+        for (d = k; d > 0; d--) {
+            chunk[d - 1] = nodes[p].component;
+            p = nodes[p].parent;
+        }
+        status = encode_core(trie->codec, chunk, k,
+                outbuf + bitlen / CHAR_BIT, bitlen % CHAR_BIT, 0,
+                &chunkbitlen, 1, 0, 0);
+        if (status != ORDPATH_SUCCESS) {
+            return status;
+        }
+        bitlen += chunkbitlen;
+        j += k;
+    } while (j < depth);
+    *poutbitlen = bitlen;
+    return ORDPATH_SUCCESS;
+}
+
+
+
+
+/*
+ * Decoded label cache. The cache is split into shards (selected by the
+ * high bits of ordpath_hash()), a shard is an array of fixed size
+ * entries (slab) and an open addressing hash table (linear probing) of
+ * entry indices. An entry keeps the encoded label (compared bit for
+ * bit, the hash alone doesn't identify the label) followed by the
+ * decoded components. Labels that don't fit an entry aren't cached.
+ *
+ * Readers never lock. The shard's sequence counter is odd while the
+ * shard is modified (seqlock); a reader copies the components to a
+ * local array and retries if the counter changed meanwhile. Writers
+ * are serialized with a per-shard mutex. Everything a reader may see
+ * while it is being modified (table slots, entries) is accessed with
+ * relaxed atomics, ordering comes from fences around the counter.
+ *
+ * Once a shard is full, the victim is picked with CLOCK: the hand
+ * sweeps the slab clearing reference bits (set by hits) and stops at
+ * the first entry with the bit clear.
+ */
+
+#define CACHE_SHARDS           16
+#define CACHE_SHARD_BITS       4
+#define CACHE_ENTRY_WORDS      14
+#define CACHE_RETRIES          4
+#define CACHE_BYPASS_BITS      64
+
+struct cacheentry {
+    uint64_t                   hash;
+    uint32_t                   bitlen;
+    uint16_t                   len;
+    uint8_t                    ref;       /* CLOCK reference bit */
+    uint8_t                    reserved;
+    /* encoded label (whole words), then components */
+    int64_t                    data [CACHE_ENTRY_WORDS];
+};
+
+struct cacheshard {
+    uint32_t                   seq;
+    pthread_mutex_t            lock;
+    size_t                     n;         /* entries in use */
+    size_t                     hand;
+    uint32_t                  *table;     /* entry index + 1, 0 if empty */
+    struct cacheentry         *entries;
+    uint64_t                   hits;
+    uint64_t                   misses;
+    uint64_t                   prefixhits;
+} __attribute__((aligned(64)));
+
+struct ordpath_cache {
+    const codec_t             *codec;
+    int                        flags;
+    size_t                     nentries;  /* per shard */
+    size_t                     tabmask;
+    struct cacheshard          shards [CACHE_SHARDS];
+};
+
+typedef ordpath_cache_t cache_t;
+
+#define CACHE_SHARD(cache, hash) \
+    ((cache)->shards + ((hash) >> (64 - CACHE_SHARD_BITS)))
+
+#define CACHE_WORDS(bitlen)    (((bitlen) + 63) / 64)
+
+#define CACHE_COUNT(counter) \
+    __atomic_fetch_add(&(counter), 1, __ATOMIC_RELAXED)
+
+#define CACHE_LOAD(field)      __atomic_load_n(&(field), __ATOMIC_RELAXED)
+
+#define CACHE_STORE(field, value) \
+    __atomic_store_n(&(field), (value), __ATOMIC_RELAXED)
+
+
+/* compare the entry's encoded label with inbuf, bits past the end are 0 */
+static inline int cache_equal(
+    const int64_t *restrict data,
+    const char *restrict inbuf,
+    size_t inbitlen)
+{
+    size_t i, nwords = inbitlen / 64;
+    int tailbits = inbitlen % 64;
+    int64_t w;
+
+    for (i = 0; i < nwords; i++) {
+        memcpy(&w, inbuf + 8 * i, sizeof w);
+        if (CACHE_LOAD(data[i]) != w) {
+            return 0;
+        }
+    }
+    if (tailbits) {
+        w = CACHE_LOAD(data[i]);
+        return load_be64((const char *)&w)
+            == (load_be64(inbuf + 8 * i) & (~UINT64_C(0) << (64 - tailbits)));
+    }
+    return 1;
+}
+
+/*
+ * Look the label up; on a hit the components are stored in *label*.
+ * Entries read may be torn (a writer is active): the encoded label is
+ * compared in place, the components of the matching entry are copied
+ * to a local array and only stored once the sequence counter confirms
+ * the read.
+ */
+static inline int cache_lookup(
+    const cache_t *restrict cache,
+    struct cacheshard *restrict shard,
+    uint64_t hash,
+    const char *restrict inbuf,
+    size_t inbitlen,
+    int64_t *restrict label,
+    size_t *restrict plablen)
+{
+    int64_t tmp [CACHE_ENTRY_WORDS];
+    size_t words = CACHE_WORDS(inbitlen);
+
+    if (words >= CACHE_ENTRY_WORDS) {
+        return 0;
+    }
+    for (int retry = 0; retry < CACHE_RETRIES; retry++) {
+        uint32_t seq = __atomic_load_n(&shard->seq, __ATOMIC_ACQUIRE);
+        struct cacheentry *found = NULL;
+        size_t i = hash & cache->tabmask, len = 0, k;
+
+        if (seq & 1) {
+            continue;
+        }
+        for (k = 0; k <= cache->tabmask; k++) {
+            uint32_t e = CACHE_LOAD(shard->table[i]);
+            struct cacheentry *entry;
+            if (!e) {
+                break;
+            }
+            entry = shard->entries + e - 1;
+            if (CACHE_LOAD(entry->hash) == hash
+                    && CACHE_LOAD(entry->bitlen) == inbitlen
+                    && cache_equal(entry->data, inbuf, inbitlen)) {
+                len = CACHE_LOAD(entry->len);
+                if (words + len > CACHE_ENTRY_WORDS) {
+                    break;
+                }
+                for (size_t j = 0; j < len; j++) {
+                    tmp[j] = CACHE_LOAD(entry->data[words + j]);
+                }
+                found = entry;
+                break;
+            }
+            i = (i + 1) & cache->tabmask;
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&shard->seq, __ATOMIC_RELAXED) != seq) {
+            continue;
+        }
+        if (!found) {
+            return 0;
+        }
+        if (!CACHE_LOAD(found->ref)) {
+            CACHE_STORE(found->ref, 1);
+        }
+        memcpy(label, tmp, len * sizeof tmp[0]);
+        *plablen = len;
+        return 1;
+    }
+    return 0;
+}
+
+/* remove entry #e from the table (backward shift deletion) */
+static void cache_unlink(
+    const cache_t *cache,
+    struct cacheshard *shard,
+    size_t e)
+{
+    size_t mask = cache->tabmask, i = shard->entries[e].hash & mask, j, k;
+    while (shard->table[i] != e + 1) {
+        i = (i + 1) & mask;
+    }
+    for (j = (i + 1) & mask; shard->table[j]; j = (j + 1) & mask) {
+        k = shard->entries[shard->table[j] - 1].hash & mask;
+        /* the entry at j may move to i unless its home is in (i, j] */
+        if (((j - k) & mask) >= ((j - i) & mask)) {
+            __atomic_store_n(shard->table + i, shard->table[j],
+                    __ATOMIC_RELAXED);
+            i = j;
+        }
+    }
+    __atomic_store_n(shard->table + i, 0, __ATOMIC_RELAXED);
+}
+
+static void cache_insert(
+    const cache_t *restrict cache,
+    struct cacheshard *restrict shard,
+    uint64_t hash,
+    const char *restrict inbuf,
+    size_t inbitlen,
+    const int64_t *restrict label,
+    size_t lablen)
+{
+    size_t words = CACHE_WORDS(inbitlen), i, e;
+    struct cacheentry *entry;
+    int64_t tmp [CACHE_ENTRY_WORDS];
+    size_t tmplen;
+
+    if (words + lablen > CACHE_ENTRY_WORDS) {
+        return;
+    }
+    pthread_mutex_lock(&shard->lock);
+
+    /* inserted by another thread meanwhile? */
+    if (cache_lookup(cache, shard, hash, inbuf, inbitlen, tmp, &tmplen)) {
+        pthread_mutex_unlock(&shard->lock);
+        return;
+    }
+
+    __atomic_store_n(&shard->seq, shard->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    if (shard->n < cache->nentries) {
+        e = shard->n++;
+    } else {
+        while (CACHE_LOAD(shard->entries[shard->hand].ref)) {
+            CACHE_STORE(shard->entries[shard->hand].ref, 0);
+            shard->hand = (shard->hand + 1) % cache->nentries;
+        }
+        e = shard->hand;
+        shard->hand = (shard->hand + 1) % cache->nentries;
+        cache_unlink(cache, shard, e);
+    }
+    entry = shard->entries + e;
+    CACHE_STORE(entry->hash, hash);
+    CACHE_STORE(entry->bitlen, (uint32_t)inbitlen);
+    CACHE_STORE(entry->len, (uint16_t)lablen);
+    CACHE_STORE(entry->ref, 0);
+    /* rendered on the stack, then stored word by word */
+    memset(tmp, 0, words * sizeof tmp[0]);
+    memcpy(tmp, inbuf, (inbitlen + CHAR_BIT - 1) / CHAR_BIT);
+    memcpy(tmp + words, label, lablen * sizeof label[0]);
+    for (i = 0; i < words + lablen; i++) {
+        CACHE_STORE(entry->data[i], tmp[i]);
+    }
+
+    for (i = hash & cache->tabmask; shard->table[i];
+            i = (i + 1) & cache->tabmask) {
+    }
+    __atomic_store_n(shard->table + i, e + 1, __ATOMIC_RELAXED);
+
+    __atomic_store_n(&shard->seq, shard->seq + 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&shard->lock);
+}
+
+void
+ordpath_cache_destroy(
+    cache_t *cache)
+{
+    if (cache) {
+        for (int s = 0; s < CACHE_SHARDS; s++) {
+            pthread_mutex_destroy(&cache->shards[s].lock);
+            free(cache->shards[s].table);
+            free(cache->shards[s].entries);
+        }
+        free(cache);
+    }
+}
+
+/*
+ * The table has at least twice as many slots as there are entries
+ * (load factor <= 1/2); a slot takes 4 bytes, an entry 128 bytes.
+ */
+status_t
+ordpath_cache_create(
+    cache_t **pcache,
+    const codec_t *codec,
+    size_t maxbytes,
+    int flags)
+{
+    cache_t *cache;
+    size_t perentry = sizeof(struct cacheentry) + 4 * sizeof(uint32_t);
+    size_t nentries = maxbytes / CACHE_SHARDS / perentry, tabsize = 2;
+
+    *pcache = NULL;
+    if (nentries == 0 || nentries > UINT32_MAX / 4) {
+        DEBUG("Cache size must be %zu..%zu bytes",
+            CACHE_SHARDS * perentry,
+            (size_t)UINT32_MAX / 4 * CACHE_SHARDS * perentry);
+        return ORDPATH_INVAL;
+    }
+    while (tabsize < 2 * nentries) {
+        tabsize *= 2;
+    }
+    if (posix_memalign((void **)&cache, 64, sizeof *cache)) {
+        return ORDPATH_OUTOFMEM;
+    }
+    memset(cache, 0, sizeof *cache);
+    cache->codec = codec;
+    cache->flags = flags;
+    cache->nentries = nentries;
+    cache->tabmask = tabsize - 1;
+    /* mutexes first, ordpath_cache_destroy() destroys all of them */
+    for (int s = 0; s < CACHE_SHARDS; s++) {
+        pthread_mutex_init(&cache->shards[s].lock, NULL);
+    }
+    for (int s = 0; s < CACHE_SHARDS; s++) {
+        struct cacheshard *shard = cache->shards + s;
+        if (!(shard->table = calloc(tabsize, sizeof shard->table[0]))
+                || !(shard->entries = malloc(
+                        nentries * sizeof shard->entries[0]))) {
+            ordpath_cache_destroy(cache);
+            return ORDPATH_OUTOFMEM;
+        }
+    }
+    *pcache = cache;
+    return ORDPATH_SUCCESS;
+}
+
+status_t
+ordpath_decode_cached(
+    cache_t *restrict cache,
+    const char *restrict inbuf,
+    size_t inbitlen,
+    int64_t *restrict label,
+    size_t *restrict plablen)
+{
+    const codec_t *codec = cache->codec;
+    struct cacheshard *shard;
+    uint64_t hash;
+    status_t status;
+
+#ifndef NDEBUG
+    if ((uintptr_t)inbuf & (ORDPATH_BUF_ALIGNMENT - 1)) {
+        DEBUG("Unaligned buffer, expected alignment %d",
+            ORDPATH_BUF_ALIGNMENT);
+        return ORDPATH_INVAL;
+    }
+#endif
+
+    /* a word is decoded faster than it is looked up, bypass the cache */
+    if (inbitlen <= CACHE_BYPASS_BITS) {
+        return decode_core(codec, inbuf, 0, inbitlen, label, plablen, 0);
+    }
+    hash = ordpath_hash(inbuf, inbitlen);
+    shard = CACHE_SHARD(cache, hash);
+
+    /* every lookup is counted once: a hit, a prefix hit or a miss */
+    if (cache_lookup(cache, shard, hash, inbuf, inbitlen, label, plablen)) {
+        CACHE_COUNT(shard->hits);
+        return ORDPATH_SUCCESS;
+    }
+
+    /* the parent is cached: decode the rest only */
+    if (cache->flags & ORDPATH_CACHE_PREFIX) {
+        size_t depth, pbitlen, n, m;
+        if (scan_levels(codec, inbuf, inbitlen, &depth, &pbitlen)
+                    == ORDPATH_SUCCESS && pbitlen > CACHE_BYPASS_BITS) {
+            uint64_t phash = ordpath_hash(inbuf, pbitlen);
+            if (cache_lookup(cache, CACHE_SHARD(cache, phash), phash,
+                        inbuf, pbitlen, label, &n)) {
+                CACHE_COUNT(shard->prefixhits);
+                status = decode_core(codec, inbuf + pbitlen / CHAR_BIT,
+                        pbitlen % CHAR_BIT, inbitlen - pbitlen,
+                        label + n, &m, 1);
+                if (status != ORDPATH_SUCCESS) {
+                    return status;
+                }
+                *plablen = n + m;
+                goto insert;
+            }
+        }
+    }
+
+    CACHE_COUNT(shard->misses);
+    status = decode_core(codec, inbuf, 0, inbitlen, label, plablen, 0);
+    if (status != ORDPATH_SUCCESS) {
+        return status;
+    }
+insert:
+    cache_insert(cache, shard, hash, inbuf, inbitlen, label, *plablen);
+    return ORDPATH_SUCCESS;
+}
+
+void
+ordpath_cache_stats(
+    const cache_t *cache,
+    uint64_t *phits,
+    uint64_t *pmisses,
+    uint64_t *pprefixhits,
+    size_t *pbytes)
+{
+    uint64_t hits = 0, misses = 0, prefixhits = 0;
+    for (int s = 0; s < CACHE_SHARDS; s++) {
+        const struct cacheshard *shard = cache->shards + s;
+        hits += __atomic_load_n(&shard->hits, __ATOMIC_RELAXED);
+        misses += __atomic_load_n(&shard->misses, __ATOMIC_RELAXED);
+        prefixhits += __atomic_load_n(&shard->prefixhits, __ATOMIC_RELAXED);
+    }
+    *phits = hits;
+    *pmisses = misses;
+    *pprefixhits = prefixhits;
+    *pbytes = sizeof *cache + CACHE_SHARDS * (
+            (cache->tabmask + 1) * sizeof cache->shards[0].table[0]
+            + cache->nentries * sizeof cache->shards[0].entries[0]);
+}
@@ -1,8 +1,13 @@
 #ifndef _ORDPATH_H
 #define _ORDPATH_H
 
+#include <stddef.h>
 #include <stdint.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 extern const char * const ordpath_compile_options;
 
 typedef
@@ -11,10 +16,12 @@ enum ordpath_status {
     ORDPATH_INTERNALERROR = 1,
     ORDPATH_OUTOFMEM = 2,
     ORDPATH_INVAL = 3,
+    ORDPATH_BUFTOOSMALL = 4,
     ORDPATH_SETUPPARSE = 10,
     ORDPATH_SETUPINVAL = 11,
     ORDPATH_SETUPLIMIT = 12,
-    ORDPATH_CORRUPTDATA = 20
+    ORDPATH_CORRUPTDATA = 20,
+    ORDPATH_OUTOFRANGE = 21
 }
 ordpath_status_t;
 
@@ -54,5 +61,438 @@ ordpath_decode(
     int64_t label[],
     size_t *plablen);
 
+ordpath_status_t
+ordpath_encode_at(
+    const ordpath_codec_t *codec,
+    const int64_t label[],
+    size_t lablen,
+    char outbuf[],
+    size_t outbitoff,
+    size_t *poutbitlen);
+
+ordpath_status_t
+ordpath_encode_exact(
+    const ordpath_codec_t *codec,
+    const int64_t label[],
+    size_t lablen,
+    char outbuf[],
+    size_t outbufsize,
+    size_t *poutbitlen);
+
+ordpath_status_t
+ordpath_encoded_bitlen(
+    const ordpath_codec_t *codec,
+    const int64_t label[],
+    size_t lablen,
+    size_t *pbitlen);
+
+ordpath_status_t
+ordpath_decoded_maxlen(
+    const ordpath_codec_t *codec,
+    size_t inbitlen,
+    size_t *pmaxlen);
+
+ordpath_status_t
+ordpath_decode_at(
+    const ordpath_codec_t *codec,
+    const char inbuf[],
+    size_t inbitoff,
+    size_t inbitlen,
+    int64_t label[],
+    size_t *plablen);
+
+ordpath_status_t
+ordpath_encode_delimited(
+    const ordpath_codec_t *codec,
+    const int64_t label[],
+    size_t lablen,
+    char outbuf[],
+    size_t outbitoff,
+    size_t outbufsize,
+    size_t *poutbitlen);
+
+ordpath_status_t
+ordpath_decode_delimited(
+    const ordpath_codec_t *codec,
+    const char inbuf[],
+    size_t inbitoff,
+    size_t inbitlen,
+    int64_t label[],
+    size_t labsize,
+    size_t *plablen,
+    size_t *plabelbitlen);
+
+ordpath_status_t
+ordpath_skip_delimited(
+    const ordpath_codec_t *codec,
+    const char inbuf[],
+    size_t inbitoff,
+    size_t inbitlen,
+    size_t *plabelbitlen);
+
+ordpath_status_t
+ordpath_decode_parallel(
+    const ordpath_codec_t *codec,
+    const char inbuf[],
+    size_t inbitlen,
+    int64_t label[],
+    size_t *plablen,
+    int nthreads);
+
+ordpath_status_t
+ordpath_decode_batch(
+    const ordpath_codec_t *codec,
+    size_t n,
+    const char * const inbufs[],
+    const size_t inbitlens[],
+    int64_t * const labels[],
+    size_t lablens[],
+    ordpath_status_t statuses[]);
+
+uint64_t
+ordpath_hash(
+    const char inbuf[],
+    size_t inbitlen);
+
+void
+ordpath_hash_batch(
+    size_t n,
+    const char * const inbufs[],
+    const size_t inbitlens[],
+    uint64_t hashes[]);
+
+ordpath_status_t
+ordpath_depth(
+    const ordpath_codec_t *codec,
+    const char inbuf[],
+    size_t inbitlen,
+    size_t *pdepth);
+
+ordpath_status_t
+ordpath_parent(
+    const ordpath_codec_t *codec,
+    const char inbuf[],
+    size_t inbitlen,
+    size_t *pparentbitlen);
+
+ordpath_status_t
+ordpath_depth_batch(
+    const ordpath_codec_t *codec,
+    size_t n,
+    const char * const inbufs[],
+    const size_t inbitlens[],
+    size_t depths[],
+    ordpath_status_t statuses[]);
+
+ordpath_status_t
+ordpath_parent_batch(
+    const ordpath_codec_t *codec,
+    size_t n,
+    const char * const inbufs[],
+    const size_t inbitlens[],
+    size_t parentbitlens[],
+    ordpath_status_t statuses[]);
+
+typedef
+enum ordpath_axis {
+    ORDPATH_AXIS_DESCENDANT = 0,
+    ORDPATH_AXIS_CHILD = 1
+}
+ordpath_axis_t;
+
+ordpath_status_t
+ordpath_join(
+    const ordpath_codec_t *codec,
+    ordpath_axis_t axis,
+    size_t na,
+    const char * const abufs[],
+    const size_t abitlens[],
+    size_t nd,
+    const char * const dbufs[],
+    const size_t dbitlens[],
+    int (*emit)(void *ctx, size_t a, size_t d),
+    void *ctx);
+
+ordpath_status_t
+ordpath_common_prefix(
+    const ordpath_codec_t *codec,
+    const char abuf[],
+    size_t abitlen,
+    const char bbuf[],
+    size_t bbitlen,
+    size_t *pncomps,
+    size_t *pbitlen);
+
+ordpath_status_t
+ordpath_lca(
+    const ordpath_codec_t *codec,
+    const char abuf[],
+    size_t abitlen,
+    const char bbuf[],
+    size_t bbitlen,
+    size_t *plcabitlen);
+
+ordpath_status_t
+ordpath_lca_batch(
+    const ordpath_codec_t *codec,
+    size_t n,
+    const char * const abufs[],
+    const size_t abitlens[],
+    const char * const bbufs[],
+    const size_t bbitlens[],
+    size_t lcabitlens[],
+    ordpath_status_t statuses[]);
+
+ordpath_status_t
+ordpath_subtree_bounds(
+    const ordpath_codec_t *codec,
+    const char inbuf[],
+    size_t inbitlen,
+    char lower[],
+    size_t *plowerbitlen,
+    char upper[],
+    size_t *pupperbitlen);
+
+ordpath_status_t
+ordpath_subtree_bounds_batch(
+    const ordpath_codec_t *codec,
+    size_t n,
+    const char * const inbufs[],
+    const size_t inbitlens[],
+    char * const lowers[],
+    size_t lowerbitlens[],
+    char * const uppers[],
+    size_t upperbitlens[]);
+
+typedef struct ordpath_columns ordpath_columns_t;
+
+ordpath_status_t
+ordpath_columns_create(
+    ordpath_columns_t **pcols,
+    const ordpath_codec_t *codec,
+    size_t n,
+    const char * const inbufs[],
+    const size_t inbitlens[]);
+
+void
+ordpath_columns_destroy(
+    ordpath_columns_t *cols);
+
+void
+ordpath_columns_shape(
+    const ordpath_columns_t *cols,
+    size_t *pn,
+    size_t *pncolumns);
+
+ordpath_status_t
+ordpath_columns_filter(
+    const ordpath_columns_t *cols,
+    size_t column,
+    int64_t min,
+    int64_t max,
+    uint64_t bitmap[]);
+
+ordpath_status_t
+ordpath_columns_get(
+    const ordpath_columns_t *cols,
+    size_t row,
+    int64_t label[],
+    size_t *plablen);
+
+ordpath_status_t
+ordpath_columns_encode(
+    const ordpath_columns_t *cols,
+    size_t row,
+    char outbuf[],
+    size_t *poutbitlen);
+
+ordpath_status_t
+ordpath_transcode(
+    const ordpath_codec_t *from,
+    const ordpath_codec_t *to,
+    const char inbuf[],
+    size_t inbitlen,
+    char outbuf[],
+    size_t *poutbitlen);
+
+ordpath_status_t
+ordpath_transcode_batch(
+    const ordpath_codec_t *from,
+    const ordpath_codec_t *to,
+    size_t n,
+    const char * const inbufs[],
+    const size_t inbitlens[],
+    char * const outbufs[],
+    size_t outbitlens[],
+    ordpath_status_t statuses[]);
+
+ordpath_status_t
+ordpath_transcode_bulk(
+    const ordpath_codec_t *from,
+    const ordpath_codec_t *to,
+    size_t n,
+    const char * const inbufs[],
+    const size_t inbitlens[],
+    char * const outbufs[],
+    size_t outbitlens[],
+    ordpath_status_t statuses[],
+    int nthreads);
+
+#define ORDPATH_FAMILY_MAX                  8
+
+typedef struct ordpath_family ordpath_family_t;
+
+ordpath_status_t
+ordpath_family_create(
+    ordpath_family_t **pfamily,
+    const char * const setupstrs[],
+    size_t n);
+
+void
+ordpath_family_destroy(
+    ordpath_family_t *family);
+
+ordpath_status_t
+ordpath_family_encode(
+    const ordpath_family_t *family,
+    const int64_t label[],
+    size_t lablen,
+    char outbuf[],
+    size_t *poutbitlen);
+
+ordpath_status_t
+ordpath_family_decode(
+    const ordpath_family_t *family,
+    const char inbuf[],
+    size_t inbitlen,
+    int64_t label[],
+    size_t *plablen);
+
+ordpath_status_t
+ordpath_family_compare(
+    const ordpath_family_t *family,
+    const char a[],
+    size_t abitlen,
+    const char b[],
+    size_t bbitlen,
+    int *presult);
+
+#define ORDPATH_TRIE_ROOT                   0
+#define ORDPATH_TRIE_NONE                   ((size_t)-1)
+
+typedef struct ordpath_trie ordpath_trie_t;
+
+ordpath_status_t
+ordpath_trie_create(
+    ordpath_trie_t **ptrie,
+    const ordpath_codec_t *codec,
+    size_t n,
+    const char * const inbufs[],
+    const size_t inbitlens[],
+    size_t nodes[]);
+
+void
+ordpath_trie_destroy(
+    ordpath_trie_t *trie);
+
+ordpath_status_t
+ordpath_trie_intern(
+    ordpath_trie_t *trie,
+    const char inbuf[],
+    size_t inbitlen,
+    size_t *pnode);
+
+ordpath_status_t
+ordpath_trie_remove(
+    ordpath_trie_t *trie,
+    size_t node);
+
+ordpath_status_t
+ordpath_trie_compact(
+    ordpath_trie_t *trie,
+    size_t remap[]);
+
+void
+ordpath_trie_shape(
+    const ordpath_trie_t *trie,
+    size_t *pnnodes,
+    size_t *pnlive,
+    size_t *pbytes);
+
+size_t
+ordpath_trie_parent(
+    const ordpath_trie_t *trie,
+    size_t node);
+
+size_t
+ordpath_trie_first_child(
+    const ordpath_trie_t *trie,
+    size_t node);
+
+size_t
+ordpath_trie_next_sibling(
+    const ordpath_trie_t *trie,
+    size_t node);
+
+size_t
+ordpath_trie_depth(
+    const ordpath_trie_t *trie,
+    size_t node);
+
+ordpath_status_t
+ordpath_trie_component(
+    const ordpath_trie_t *trie,
+    size_t node,
+    int64_t *pcomponent);
+
+ordpath_status_t
+ordpath_trie_label(
+    const ordpath_trie_t *trie,
+    size_t node,
+    int64_t label[],
+    size_t *plablen);
+
+ordpath_status_t
+ordpath_trie_encode(
+    const ordpath_trie_t *trie,
+    size_t node,
+    char outbuf[],
+    size_t *poutbitlen);
+
+#define ORDPATH_CACHE_PREFIX                1
+
+typedef struct ordpath_cache ordpath_cache_t;
+
+ordpath_status_t
+ordpath_cache_create(
+    ordpath_cache_t **pcache,
+    const ordpath_codec_t *codec,
+    size_t maxbytes,
+    int flags);
+
+void
+ordpath_cache_destroy(
+    ordpath_cache_t *cache);
+
+ordpath_status_t
+ordpath_decode_cached(
+    ordpath_cache_t *cache,
+    const char inbuf[],
+    size_t inbitlen,
+    int64_t label[],
+    size_t *plablen);
+
+void
+ordpath_cache_stats(
+    const ordpath_cache_t *cache,
+    uint64_t *phits,
+    uint64_t *pmisses,
+    uint64_t *pprefixhits,
+    size_t *pbytes);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif
 
@@ -0,0 +1,409 @@
+#ifndef _ORDPATH_HPP
+#define _ORDPATH_HPP
+
+/*
+ * Header-only C++ wrapper for the ORDPATH library (C++20).
+ *
+ * Codec          - RAII wrapper for ordpath_codec_t
+ * Label          - decoded label, a small vector with inline storage
+ * EncodedLabel   - encoded label with inline storage, buffer is
+ *                  aligned as required by ordpath_encode()/decode()
+ * EncodedView    - non-owning view of an encoded label (ex: a label
+ *                  residing in a page or an arena)
+ *
+ * Typical labels fit inline storage and never touch the heap.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "ordpath.h"
+
+namespace ordpath {
+
+class Error : public std::runtime_error
+{
+public:
+    explicit Error(ordpath_status_t status)
+        : std::runtime_error(message(status)), status_(status) {}
+
+    ordpath_status_t status() const noexcept { return status_; }
+
+    static void check(ordpath_status_t status)
+    {
+        if (status != ORDPATH_SUCCESS) {
+            throw Error(status);
+        }
+    }
+
+private:
+    static std::string message(ordpath_status_t status)
+    {
+        char buf[96];
+        ordpath_strerror(status, buf, sizeof buf);
+        return buf;
+    }
+
+    ordpath_status_t status_;
+};
+
+namespace detail {
+
+/*
+ * Storage that keeps up to N elements inline and switches to the heap
+ * when more is needed. Heap memory is aligned at ORDPATH_BUF_ALIGNMENT
+ * and rounded up to ORDPATH_BUF_ALIGNMENT bytes. Move-only.
+ */
+template <typename T, std::size_t N>
+class SmallBuf
+{
+    static_assert(sizeof(T) * N % ORDPATH_BUF_ALIGNMENT == 0,
+        "inline storage must be a multiple of ORDPATH_BUF_ALIGNMENT");
+
+public:
+    SmallBuf() noexcept : ptr_(inline_), capacity_(N) {}
+
+    SmallBuf(SmallBuf &&other) noexcept : SmallBuf() { steal(other); }
+
+    SmallBuf &operator=(SmallBuf &&other) noexcept
+    {
+        if (this != &other) {
+            release();
+            steal(other);
+        }
+        return *this;
+    }
+
+    SmallBuf(const SmallBuf &) = delete;
+    SmallBuf &operator=(const SmallBuf &) = delete;
+
+    ~SmallBuf() { release(); }
+
+    T *data() noexcept { return ptr_; }
+    const T *data() const noexcept { return ptr_; }
+    std::size_t capacity() const noexcept { return capacity_; }
+    bool is_inline() const noexcept { return ptr_ == inline_; }
+
+    /* contents are discarded */
+    void reserve(std::size_t n)
+    {
+        if (n <= capacity_) {
+            return;
+        }
+        std::size_t size = (n * sizeof(T) + ORDPATH_BUF_ALIGNMENT - 1)
+            & ~std::size_t(ORDPATH_BUF_ALIGNMENT - 1);
+        T *p = static_cast<T *>(::operator new(size,
+                    std::align_val_t(ORDPATH_BUF_ALIGNMENT)));
+        release();
+        ptr_ = p;
+        capacity_ = size / sizeof(T);
+    }
+
+private:
+    void release() noexcept
+    {
+        if (!is_inline()) {
+            ::operator delete(ptr_, std::align_val_t(ORDPATH_BUF_ALIGNMENT));
+        }
+        ptr_ = inline_;
+        capacity_ = N;
+    }
+
+    void steal(SmallBuf &other) noexcept
+    {
+        if (other.is_inline()) {
+            std::memcpy(inline_, other.inline_, sizeof inline_);
+        } else {
+            ptr_ = other.ptr_;
+            capacity_ = other.capacity_;
+            other.ptr_ = other.inline_;
+            other.capacity_ = N;
+        }
+    }
+
+    alignas(ORDPATH_BUF_ALIGNMENT) T inline_[N];
+    T *ptr_;
+    std::size_t capacity_;
+};
+
+} /* namespace detail */
+
+/*
+ * Non-owning view of an encoded label. Buffer requirements are the same
+ * as in ordpath_decode().
+ */
+struct EncodedView
+{
+    const char *data;
+    std::size_t bitlen;
+
+    std::size_t size() const noexcept { return (bitlen + 7) / 8; }
+};
+
+/*
+ * Decoded label.
+ */
+class Label
+{
+public:
+    static constexpr std::size_t inline_capacity = 8;
+
+    Label() noexcept : len_(0) {}
+
+    explicit Label(std::span<const int64_t> components) : len_(0)
+    {
+        assign(components);
+    }
+
+    Label(Label &&other) noexcept
+        : buf_(std::move(other.buf_)), len_(std::exchange(other.len_, 0)) {}
+
+    Label &operator=(Label &&other) noexcept
+    {
+        if (this != &other) {
+            buf_ = std::move(other.buf_);
+            len_ = std::exchange(other.len_, 0);
+        }
+        return *this;
+    }
+
+    void assign(std::span<const int64_t> components)
+    {
+        buf_.reserve(components.size());
+        std::memcpy(buf_.data(), components.data(), components.size_bytes());
+        len_ = components.size();
+    }
+
+    std::size_t size() const noexcept { return len_; }
+    bool empty() const noexcept { return len_ == 0; }
+    bool is_inline() const noexcept { return buf_.is_inline(); }
+    const int64_t *data() const noexcept { return buf_.data(); }
+    int64_t operator[](std::size_t i) const noexcept { return buf_.data()[i]; }
+    const int64_t *begin() const noexcept { return buf_.data(); }
+    const int64_t *end() const noexcept { return buf_.data() + len_; }
+
+    std::span<const int64_t> span() const noexcept
+    {
+        return std::span<const int64_t>(buf_.data(), len_);
+    }
+
+    operator std::span<const int64_t>() const noexcept { return span(); }
+
+    bool operator==(const Label &other) const noexcept
+    {
+        return len_ == other.len_
+            && std::memcmp(data(), other.data(), len_ * sizeof(int64_t)) == 0;
+    }
+
+private:
+    friend class Codec;
+
+    detail::SmallBuf<int64_t, inline_capacity> buf_;
+    std::size_t len_;
+};
+
+/*
+ * Encoded label.
+ */
+class EncodedLabel
+{
+public:
+    static constexpr std::size_t inline_capacity = 32; /* bytes */
+
+    EncodedLabel() noexcept : bitlen_(0) {}
+
+    explicit EncodedLabel(EncodedView view) : bitlen_(0) { assign(view); }
+
+    EncodedLabel(EncodedLabel &&other) noexcept
+        : buf_(std::move(other.buf_)),
+          bitlen_(std::exchange(other.bitlen_, 0)) {}
+
+    EncodedLabel &operator=(EncodedLabel &&other) noexcept
+    {
+        if (this != &other) {
+            buf_ = std::move(other.buf_);
+            bitlen_ = std::exchange(other.bitlen_, 0);
+        }
+        return *this;
+    }
+
+    void assign(EncodedView view)
+    {
+        buf_.reserve(view.size());
+        std::memcpy(buf_.data(), view.data, view.size());
+        bitlen_ = view.bitlen;
+        /* a view may end mid-byte (ex: a parent), clear the rest */
+        if (bitlen_ % 8) {
+            buf_.data()[bitlen_ / 8] &=
+                static_cast<char>(0xff00 >> bitlen_ % 8);
+        }
+    }
+
+    const char *data() const noexcept { return buf_.data(); }
+    std::size_t bitlen() const noexcept { return bitlen_; }
+    std::size_t size() const noexcept { return (bitlen_ + 7) / 8; }
+    bool is_inline() const noexcept { return buf_.is_inline(); }
+
+    EncodedView view() const noexcept { return EncodedView{data(), bitlen_}; }
+    operator EncodedView() const noexcept { return view(); }
+
+    std::span<const char> bytes() const noexcept
+    {
+        return std::span<const char>(data(), size());
+    }
+
+    bool operator==(const EncodedLabel &other) const noexcept
+    {
+        return bitlen_ == other.bitlen_
+            && std::memcmp(data(), other.data(), size()) == 0;
+    }
+
+private:
+    friend class Codec;
+
+    detail::SmallBuf<char, inline_capacity> buf_;
+    std::size_t bitlen_;
+};
+
+/*
+ * Codec.
+ */
+class Codec
+{
+public:
+    explicit Codec(const char *setup) : codec_(nullptr), range_{0, 0}
+    {
+        Error::check(ordpath_create(&codec_, setup, range_));
+    }
+
+    Codec(Codec &&other) noexcept
+        : codec_(std::exchange(other.codec_, nullptr)),
+          range_{other.range_[0], other.range_[1]} {}
+
+    Codec &operator=(Codec &&other) noexcept
+    {
+        if (this != &other) {
+            ordpath_destroy(codec_);
+            codec_ = std::exchange(other.codec_, nullptr);
+            range_[0] = other.range_[0];
+            range_[1] = other.range_[1];
+        }
+        return *this;
+    }
+
+    Codec(const Codec &) = delete;
+    Codec &operator=(const Codec &) = delete;
+
+    ~Codec() { ordpath_destroy(codec_); }
+
+    const ordpath_codec_t *get() const noexcept { return codec_; }
+
+    /* the range of component values the codec can encode */
+    int64_t min() const noexcept { return range_[0]; }
+    int64_t max() const noexcept { return range_[1]; }
+
+    void encode(std::span<const int64_t> label, EncodedLabel &out) const
+    {
+        /*
+         * An encoded component takes at most 64 bits, encoder writes
+         * whole words. Short labels are rendered to the stack first
+         * hence the result fits inline storage if it is small enough.
+         */
+        std::size_t size = (label.size() + 1) * sizeof(int64_t);
+        if (size <= sizeof(int64_t) * scratch_words) {
+            alignas(ORDPATH_BUF_ALIGNMENT) char scratch[
+                sizeof(int64_t) * scratch_words];
+            std::size_t bitlen;
+            Error::check(ordpath_encode(codec_,
+                        label.data(), label.size(), scratch, &bitlen));
+            out.assign(EncodedView{scratch, bitlen});
+        } else {
+            out.buf_.reserve(size);
+            Error::check(ordpath_encode(codec_,
+                        label.data(), label.size(),
+                        out.buf_.data(), &out.bitlen_));
+        }
+    }
+
+    EncodedLabel encode(std::span<const int64_t> label) const
+    {
+        EncodedLabel out;
+        encode(label, out);
+        return out;
+    }
+
+    /*
+     * Decode into a caller-provided array; it must have enough capacity
+     * (see ordpath_decode()). Returns the subspan holding the label.
+     */
+    std::span<int64_t> decode(EncodedView in, std::span<int64_t> out) const
+    {
+        std::size_t len;
+        Error::check(ordpath_decode(codec_,
+                    in.data, in.bitlen, out.data(), &len));
+        return out.first(len);
+    }
+
+    void decode(EncodedView in, Label &out) const
+    {
+        /*
+         * Capacity is sized by the shortest code. Short labels are
+         * decoded to the stack first hence the result fits inline
+         * storage if it is small enough.
+         */
+        std::size_t maxlen;
+        Error::check(ordpath_decoded_maxlen(codec_, in.bitlen, &maxlen));
+        if (maxlen <= scratch_words) {
+            int64_t scratch[scratch_words];
+            out.assign(decode(in, std::span<int64_t>(scratch)));
+        } else {
+            out.buf_.reserve(maxlen);
+            out.len_ = decode(in, std::span<int64_t>(
+                        out.buf_.data(), maxlen)).size();
+        }
+    }
+
+    Label decode(EncodedView in) const
+    {
+        Label out;
+        decode(in, out);
+        return out;
+    }
+
+    std::size_t depth(EncodedView in) const
+    {
+        std::size_t depth;
+        Error::check(ordpath_depth(codec_, in.data, in.bitlen, &depth));
+        return depth;
+    }
+
+    /* zero-copy: parent's label is a prefix */
+    EncodedView parent(EncodedView in) const
+    {
+        std::size_t bitlen;
+        Error::check(ordpath_parent(codec_, in.data, in.bitlen, &bitlen));
+        return EncodedView{in.data, bitlen};
+    }
+
+private:
+    static constexpr std::size_t scratch_words = 256;
+
+    ordpath_codec_t *codec_;
+    int64_t range_[2];
+};
+
+inline uint64_t hash(EncodedView in) noexcept
+{
+    return ordpath_hash(in.data, in.bitlen);
+}
+
+} /* namespace ordpath */
+
+#endif
@@ -0,0 +1,145 @@
+/*
+ * Tests for the C++ wrapper (ordpath.hpp).
+ *
+ * ordpath-cxx-test <label> <encoded-label>
+ *
+ * Encodes the label and compares the result with the encoded label
+ * (reference data), decodes it back and compares with the label.
+ * Formats are the same as in ordpath-test.
+ */
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "ordpath.hpp"
+
+static const char setup[] = "\
+    0000001 : 48     \
+    0000010 : 32     \
+    0000011 : 16     \
+    000010  : 12     \
+    000011  : 8      \
+    00010   : 6      \
+    00011   : 4      \
+    001     : 3      \
+    01      : 3 : 0  \
+    100     : 4      \
+    101     : 6      \
+    1100    : 8      \
+    1101    : 12     \
+    11100   : 16     \
+    11101   : 32     \
+    11110   : 48";
+
+static void fail(const char *message)
+{
+    std::fprintf(stderr, "ordpath-cxx-test: %s\n", message);
+    std::exit(EXIT_FAILURE);
+}
+
+static std::vector<int64_t> read_label(const char *name)
+{
+    std::ifstream file(name);
+    std::vector<int64_t> label{std::istream_iterator<int64_t>(file),
+        std::istream_iterator<int64_t>()};
+    if (!file.eof()) {
+        fail("Bad label");
+    }
+    return label;
+}
+
+static ordpath::EncodedLabel read_elabel(const char *name)
+{
+    std::ifstream file(name, std::ios::binary);
+    std::string data{std::istreambuf_iterator<char>(file),
+        std::istreambuf_iterator<char>()};
+    std::size_t bitlen;
+    if (data.size() < 16 || std::sscanf(data.c_str(), "%zu", &bitlen) != 1
+            || data.size() != 16 + (bitlen + 7) / 8) {
+        fail("Bad encoded label");
+    }
+
+    /* copy to an aligned buffer padded to whole words */
+    std::vector<int64_t> buf((bitlen + 63) / 64 + 1);
+    std::memcpy(buf.data(), data.data() + 16, data.size() - 16);
+    return ordpath::EncodedLabel(ordpath::EncodedView{
+        reinterpret_cast<const char *>(buf.data()), bitlen});
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 3) {
+        fail("Usage: ordpath-cxx-test <label> <encoded-label>");
+    }
+
+    try {
+        ordpath::Codec codec(setup);
+        std::vector<int64_t> label = read_label(argv[1]);
+        ordpath::EncodedLabel ref = read_elabel(argv[2]);
+
+        ordpath::EncodedLabel elabel = codec.encode(label);
+        if (!(elabel == ref)) {
+            fail("Encoding result doesn't match reference data");
+        }
+        if (elabel.is_inline() != (elabel.size() <= 32)) {
+            fail("Unexpected EncodedLabel storage");
+        }
+
+        ordpath::Label decoded = codec.decode(elabel);
+        if (!(decoded == ordpath::Label(label))) {
+            fail("Decoding result doesn't match reference data");
+        }
+        if (decoded.is_inline() != (decoded.size() <= 8)) {
+            fail("Unexpected Label storage");
+        }
+
+        /* short labels never touch the heap */
+        ordpath::Label prefix(std::span<const int64_t>(label).first(
+                    std::min<std::size_t>(label.size(), 3)));
+        ordpath::EncodedLabel eprefix = codec.encode(prefix);
+        if (!prefix.is_inline() || !eprefix.is_inline()
+                || !(codec.decode(eprefix) == prefix)) {
+            fail("Short label round trip failed");
+        }
+
+        /* moves transfer ownership */
+        ordpath::EncodedLabel moved(std::move(elabel));
+        if (!(moved == ref) || elabel.bitlen() != 0) {
+            fail("Move failed");
+        }
+
+        /* zero-copy parent is a prefix */
+        ordpath::EncodedView parent = codec.parent(moved);
+        if (parent.data != moved.data() || parent.bitlen > moved.bitlen()
+                || (moved.bitlen() && codec.depth(moved) > 1
+                    && codec.depth(parent) + 1 != codec.depth(moved))) {
+            fail("Parent doesn't match");
+        }
+
+        /* a copy of the parent equals the parent encoded from scratch */
+        if (!(ordpath::EncodedLabel(parent) == codec.encode(
+                        codec.decode(parent)))) {
+            fail("Parent copy doesn't match");
+        }
+
+        /* errors are reported with exceptions */
+        try {
+            ordpath::Codec bad("01 : 3");
+            fail("Invalid setup accepted");
+        } catch (const ordpath::Error &e) {
+            if (e.status() != ORDPATH_SETUPINVAL) {
+                fail("Unexpected error status");
+            }
+        }
+    } catch (const ordpath::Error &e) {
+        fail(e.what());
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -1,5 +1,8 @@
 #include <getopt.h>
 #include <err.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <inttypes.h>
 #include <limits.h>
 #include <stddef.h>
@@ -22,163 +25,2563 @@
 #define LABEL_LEN_MAX          8193
 #define ELABEL_BITLEN_MAX      (LABEL_LEN_MAX * 64)
 #define BENCHMARK_LOOP_COUNT   16384
+#define BATCH_SIZE             16
+#define JOIN_FANOUT            8
+#define JOIN_DEPTH             7
+#define TRANSCODE_THREADS      4
+#define BULK_THREADS_MAX       64
+#define ELABEL_HEADER_SIZE     16
+
+/*
+ * Alternative setup (transcoding target), covers the builtin setup range
+ */
+#define TRANSCODE_SETUP "\
+    0000    : 50     \
+    0001    : 16     \
+    001     : 6      \
+    010     : 2      \
+    011     : 2 : 0  \
+    10      : 5      \
+    110     : 16     \
+    1110    : 34     \
+    1111    : 50"
+
+/*
+ * Narrow setup, values outside [0, 8) are out of range
+ */
+#define TRANSCODE_NARROW_SETUP "\
+    0       : 2 : 0  \
+    1       : 2"
+
+/*
+ * The builtin setup with the end-of-label code (self-delimiting labels)
+ */
+#define DELIMITED_SETUP "\
+    0000000 : end    \
+    0000001 : 48     \
+    0000010 : 32     \
+    0000011 : 16     \
+    000010  : 12     \
+    000011  : 8      \
+    00010   : 6      \
+    00011   : 4      \
+    001     : 3      \
+    01      : 3 : 0  \
+    100     : 4      \
+    101     : 6      \
+    1100    : 8      \
+    1101    : 12     \
+    11100   : 16     \
+    11101   : 32     \
+    11110   : 48"
 
 /*
  * Utility macros
  */
 
-#define SZ_FROM_BITLEN(l)      (((l)+CHAR_BIT-1)/CHAR_BIT)
+#define SZ_FROM_BITLEN(l)      (((l)+CHAR_BIT-1)/CHAR_BIT)
+
+#define BENCHMARK_LOOP_DO_NOT_OPTIMIZE() \
+    do { asm volatile ("":::"memory"); } while (0)
+
+#define TS2D(ts) \
+    ((double)ts.tv_sec + (double)ts.tv_nsec/1000000000.0)
+
+/*
+ * Structures
+ */
+
+struct range {
+    int64_t                    min;
+    int64_t                    max;
+};
+
+struct label {
+    size_t                     len;
+    int64_t                    data[ELABEL_BITLEN_MAX];
+};
+
+struct elabel {
+    size_t                     bitlen;
+    char                       padding [ORDPATH_BUF_ALIGNMENT];
+    char                       reserved [SZ_FROM_BITLEN(ELABEL_BITLEN_MAX)];
+};
+
+#define ELABEL_BUF(e) \
+    (char *)((uintptr_t)(e)->reserved & ~(uintptr_t)(ORDPATH_BUF_ALIGNMENT-1))
+
+/*
+ * Helper functions
+ */
+
+static void read_setup(const char *name, char setup[SETUP_LEN_MAX])
+{
+    FILE *file;
+    size_t size;
+    if (!(file = fopen(name, "rt"))) {
+        err(EXIT_FAILURE, "Error opening \"%s\"", name);
+    }
+    size = fread(setup, 1, SETUP_LEN_MAX - 1, file);
+    setup[size] = 0;
+    if (strlen(setup) != size || !feof(file)) {
+        errx(EXIT_FAILURE, "Bad setup \"%s\"", name);
+    }
+    fclose(file);
+}
+
+static int eq_labels(const struct label *l1, const struct label *l2)
+{
+    return l1->len == l2->len
+        && memcmp(l1->data, l2->data, l1->len * sizeof l1->data[0]) == 0;
+}
+
+static void read_label(struct label *label, FILE *file, const struct range *r)
+{
+    int64_t c;
+    for (size_t i=0; i<LABEL_LEN_MAX; i++) {
+        if (1 != fscanf(file, "%"SCNd64" ", &c)) {
+            if (!feof(file)) {
+                errx(EXIT_FAILURE, "Bad label");
+            }
+            label->len = i;
+            return;
+        }
+        if (c < r->min || c > r->max) {
+            errx(EXIT_FAILURE,
+                "Label component %"PRId64" "
+                "not in valid range [%"PRId64",%"PRId64"]",
+                c, r->min, r->max);
+        }
+        label->data[i] = c;
+    }
+    errx(EXIT_FAILURE, "Label too long");
+}
+
+static void write_label(const struct label *label, FILE *file)
+{
+    for (size_t i=0; i < label->len; i++) {
+        fprintf(file, "%"PRId64"\n", label->data[i]);
+    }
+}
+
+static int eq_elabels(const struct elabel *el1, const struct elabel *el2)
+{
+    return el1->bitlen == el2->bitlen
+        && memcmp(ELABEL_BUF(el1), ELABEL_BUF(el2), SZ_FROM_BITLEN(el1->bitlen)) == 0;
+}
+
+static void read_elabel(struct elabel *elabel, FILE *file)
+{
+    char buf[64];
+    size_t size, bitlen;
+    if (!fgets(buf, sizeof buf, file) || !strchr(buf, '\n')) {
+        goto badlabel;
+    }
+    if (1 != sscanf(buf, "%zu", &bitlen)) {
+        goto badlabel;
+    }
+    if (bitlen > ELABEL_BITLEN_MAX) {
+        errx(EXIT_FAILURE, "Encoded label too long");
+    }
+    size = SZ_FROM_BITLEN(bitlen);
+    if (size != fread(ELABEL_BUF(elabel), 1, size, file)) {
+        goto badlabel;
+    }
+    elabel->bitlen = bitlen;
+    return;
+badlabel:
+    errx(EXIT_FAILURE, "Bad encoded label");
+}
+
+static void write_elabel(const struct elabel *elabel, FILE *file)
+{
+    fprintf(file, "%-15zu\n", elabel->bitlen);
+    fwrite(ELABEL_BUF(elabel), 1, SZ_FROM_BITLEN(elabel->bitlen), file);
+}
+
+static void memcpy_benchmark(int n, const struct label *l)
+{
+    static struct label t;
+    int i;
+    for (i=0; i<n; i++) {
+        memcpy(t.data, l->data, l->len * sizeof l->data[0]);
+
+        BENCHMARK_LOOP_DO_NOT_OPTIMIZE();
+    }
+}
+
+static void encoding_benchmark(int n, const struct label *l,
+    ordpath_codec_t *codec)
+{
+    static struct elabel et;
+    int i;
+    for (i=0; i<n; i++) {
+        ordpath_encode(codec, l->data, l->len, ELABEL_BUF(&et), &et.bitlen);
+
+        BENCHMARK_LOOP_DO_NOT_OPTIMIZE();
+    }
+}
+
+static void decoding_benchmark(int n, const struct elabel *el,
+    ordpath_codec_t *codec)
+{
+    static struct label t;
+    int i;
+    for (i=0; i<n; i++) {
+        ordpath_decode(codec, ELABEL_BUF(el), el->bitlen, t.data, &t.len);
+
+        BENCHMARK_LOOP_DO_NOT_OPTIMIZE();
+    }
+}
+
+static void decoding_batch_benchmark(int n, const struct elabel *el,
+    ordpath_codec_t *codec)
+{
+    static struct label t[BATCH_SIZE];
+    const char *inbufs[BATCH_SIZE];
+    size_t inbitlens[BATCH_SIZE];
+    int64_t *labels[BATCH_SIZE];
+    size_t lablens[BATCH_SIZE];
+    int i;
+    for (i=0; i<BATCH_SIZE; i++) {
+        inbufs[i] = ELABEL_BUF(el);
+        inbitlens[i] = el->bitlen;
+        labels[i] = t[i].data;
+    }
+    for (i=0; i<n; i+=BATCH_SIZE) {
+        ordpath_decode_batch(codec, BATCH_SIZE,
+            inbufs, inbitlens, labels, lablens, NULL);
+
+        BENCHMARK_LOOP_DO_NOT_OPTIMIZE();
+    }
+}
+
+static void depth_benchmark(int n, const struct elabel *el,
+    ordpath_codec_t *codec)
+{
+    size_t depth;
+    int i;
+    for (i=0; i<n; i++) {
+        ordpath_depth(codec, ELABEL_BUF(el), el->bitlen, &depth);
+
+        BENCHMARK_LOOP_DO_NOT_OPTIMIZE();
+    }
+}
+
+static ordpath_codec_t *transcode_target(void)
+{
+    static ordpath_codec_t *to;
+    if (!to && ORDPATH_SUCCESS != ordpath_create(&to, TRANSCODE_SETUP, NULL)) {
+        errx(EXIT_FAILURE, "Failed to initialize transcoding target");
+    }
+    return to;
+}
+
+static void transcoding_benchmark(int n, const struct elabel *el,
+    ordpath_codec_t *codec)
+{
+    static struct elabel et;
+    ordpath_codec_t *to = transcode_target();
+    int i;
+    for (i=0; i<n; i++) {
+        ordpath_transcode(codec, to, ELABEL_BUF(el), el->bitlen,
+            ELABEL_BUF(&et), &et.bitlen);
+
+        BENCHMARK_LOOP_DO_NOT_OPTIMIZE();
+    }
+}
+
+static ordpath_codec_t *delimited_codec(void)
+{
+    static ordpath_codec_t *codec;
+    if (!codec && ORDPATH_SUCCESS != ordpath_create(&codec,
+                DELIMITED_SETUP, NULL)) {
+        errx(EXIT_FAILURE, "Failed to initialize delimited codec");
+    }
+    return codec;
+}
+
+static void delimited_benchmark(int n, const struct label *l, int skip)
+{
+    static struct label t;
+    static struct elabel et;
+    ordpath_codec_t *codec = delimited_codec();
+    size_t bitlen;
+    int i;
+    ordpath_encode_delimited(codec, l->data, l->len, ELABEL_BUF(&et), 0,
+        sizeof et.reserved, &et.bitlen);
+    for (i=0; i<n; i++) {
+        if (skip) {
+            ordpath_skip_delimited(codec, ELABEL_BUF(&et), 0, et.bitlen,
+                &bitlen);
+        } else {
+            ordpath_decode_delimited(codec, ELABEL_BUF(&et), 0, et.bitlen,
+                t.data, ELABEL_BITLEN_MAX, &t.len, &bitlen);
+        }
+
+        BENCHMARK_LOOP_DO_NOT_OPTIMIZE();
+    }
+}
+
+static void decode_encode_benchmark(int n, const struct elabel *el,
+    ordpath_codec_t *codec)
+{
+    static struct label t;
+    static struct elabel et;
+    ordpath_codec_t *to = transcode_target();
+    int i;
+    for (i=0; i<n; i++) {
+        ordpath_decode(codec, ELABEL_BUF(el), el->bitlen, t.data, &t.len);
+        ordpath_encode(to, t.data, t.len, ELABEL_BUF(&et), &et.bitlen);
+
+        BENCHMARK_LOOP_DO_NOT_OPTIMIZE();
+    }
+}
+
+/*
+ * Decode a label using ordpath_decode_batch(). The label is replicated
+ * several times and interleaved with empty labels so that lanes finish
+ * at different times; every copy must decode identically.
+ */
+static ordpath_status_t decode_batch(ordpath_codec_t *codec,
+    const struct elabel *el, struct label *label)
+{
+    const char *inbufs[BATCH_SIZE-1];
+    size_t inbitlens[BATCH_SIZE-1];
+    int64_t *labels[BATCH_SIZE-1];
+    size_t lablens[BATCH_SIZE-1];
+    ordpath_status_t statuses[BATCH_SIZE-1], status;
+    size_t i, n = BATCH_SIZE-1;
+
+    for (i=0; i<n; i++) {
+        inbufs[i] = ELABEL_BUF(el);
+        inbitlens[i] = (i % 3 == 1) ? 0 : el->bitlen;
+        labels[i] = (i == 0) ? label->data :
+            malloc((el->bitlen + 1) * sizeof label->data[0]);
+        if (!labels[i]) {
+            errx(EXIT_FAILURE, "Out of memory");
+        }
+    }
+    status = ordpath_decode_batch(codec, n,
+        inbufs, inbitlens, labels, lablens, statuses);
+    label->len = lablens[0];
+    for (i=1; i<n; i++) {
+        if (statuses[i] != statuses[0] && inbitlens[i] != 0) {
+            errx(EXIT_FAILURE, "Batch decoding is inconsistent");
+        }
+        if (status == ORDPATH_SUCCESS
+                && (inbitlens[i] == 0 ? lablens[i] != 0 :
+                    lablens[i] != label->len || memcmp(labels[i],
+                        label->data, label->len * sizeof label->data[0]))) {
+            errx(EXIT_FAILURE, "Batch decoding is inconsistent");
+        }
+        free(labels[i]);
+    }
+    return status;
+}
+
+/*
+ * Unaligned encoding and decoding. Labels are placed at odd byte
+ * addresses and at every bit offset; bits around the label are filled
+ * with a pattern that must be preserved.
+ */
+
+#define UNALIGNED_BYTEOFF      3
+#define UNALIGNED_PATTERN      0xa5
+
+static int get_bit(const char *buf, size_t pos)
+{
+    return (buf[pos / CHAR_BIT] >> (CHAR_BIT - 1 - pos % CHAR_BIT)) & 1;
+}
+
+static void put_bit(char *buf, size_t pos, int bit)
+{
+    int mask = 1 << (CHAR_BIT - 1 - pos % CHAR_BIT);
+    buf[pos / CHAR_BIT] = (buf[pos / CHAR_BIT] & ~mask) | (bit ? mask : 0);
+}
+
+static ordpath_status_t encode_unaligned(ordpath_codec_t *codec,
+    const struct label *label, struct elabel *el)
+{
+    static struct elabel t;
+    char *buf = t.reserved + UNALIGNED_BYTEOFF;
+    ordpath_status_t status = ORDPATH_SUCCESS;
+
+    for (int bitoff = 0; bitoff < CHAR_BIT; bitoff++) {
+        size_t bitlen, size;
+        memset(t.reserved, UNALIGNED_PATTERN, sizeof t.reserved);
+        status = ordpath_encode_at(codec,
+            label->data, label->len, buf, bitoff, &bitlen);
+        if (status != ORDPATH_SUCCESS) {
+            return status;
+        }
+        size = SZ_FROM_BITLEN(bitoff + bitlen);
+        for (int i = 0; i < bitoff; i++) {
+            if (get_bit(buf, i) != get_bit((char []){UNALIGNED_PATTERN}, i)) {
+                errx(EXIT_FAILURE, "Leading bits damaged");
+            }
+        }
+        for (size_t i = bitoff + bitlen; i < size * CHAR_BIT; i++) {
+            if (get_bit(buf, i) != get_bit((char []){UNALIGNED_PATTERN},
+                        i % CHAR_BIT)) {
+                errx(EXIT_FAILURE, "Trailing bits damaged");
+            }
+        }
+        if (buf[-1] != (char)UNALIGNED_PATTERN
+                || buf[size] != (char)UNALIGNED_PATTERN) {
+            errx(EXIT_FAILURE, "Data written out of bounds");
+        }
+        el->bitlen = bitlen;
+        memset(ELABEL_BUF(el), 0, SZ_FROM_BITLEN(bitlen));
+        for (size_t i = 0; i < bitlen; i++) {
+            put_bit(ELABEL_BUF(el), i, get_bit(buf, bitoff + i));
+        }
+    }
+    return status;
+}
+
+/*
+ * Encode into a buffer of the exact size (as reported by the size
+ * query), check that nothing is written out of bounds and that a buffer
+ * one byte shorter is rejected.
+ */
+static ordpath_status_t encode_exact(ordpath_codec_t *codec,
+    const struct label *label, struct elabel *el)
+{
+    static struct elabel t;
+    char *buf = t.reserved + UNALIGNED_BYTEOFF;
+    ordpath_status_t status;
+    size_t bitlen, size;
+
+    status = ordpath_encoded_bitlen(codec, label->data, label->len, &bitlen);
+    if (status != ORDPATH_SUCCESS) {
+        return status;
+    }
+    size = SZ_FROM_BITLEN(bitlen);
+
+    if (size != 0) {
+        memset(t.reserved, UNALIGNED_PATTERN, sizeof t.reserved);
+        status = ordpath_encode_exact(codec,
+            label->data, label->len, buf, size - 1, &el->bitlen);
+        if (status != ORDPATH_BUFTOOSMALL) {
+            errx(EXIT_FAILURE, "Short buffer accepted");
+        }
+        if (buf[size - 1] != (char)UNALIGNED_PATTERN) {
+            errx(EXIT_FAILURE, "Data written out of bounds");
+        }
+    }
+
+    memset(t.reserved, UNALIGNED_PATTERN, sizeof t.reserved);
+    status = ordpath_encode_exact(codec,
+        label->data, label->len, buf, size, &el->bitlen);
+    if (status != ORDPATH_SUCCESS) {
+        return status;
+    }
+    if (el->bitlen != bitlen) {
+        errx(EXIT_FAILURE, "Size query doesn't match encoded label");
+    }
+    if (buf[-1] != (char)UNALIGNED_PATTERN
+            || buf[size] != (char)UNALIGNED_PATTERN) {
+        errx(EXIT_FAILURE, "Data written out of bounds");
+    }
+    memcpy(ELABEL_BUF(el), buf, size);
+    return status;
+}
+
+static ordpath_status_t decode_unaligned(ordpath_codec_t *codec,
+    const struct elabel *el, struct label *label)
+{
+    static struct elabel t;
+    char *buf = t.reserved + UNALIGNED_BYTEOFF;
+    ordpath_status_t status = ORDPATH_SUCCESS;
+
+    for (int bitoff = 0; bitoff < CHAR_BIT; bitoff++) {
+        memset(t.reserved, UNALIGNED_PATTERN, sizeof t.reserved);
+        for (size_t i = 0; i < el->bitlen; i++) {
+            put_bit(buf, bitoff + i, get_bit(ELABEL_BUF(el), i));
+        }
+        status = ordpath_decode_at(codec,
+            buf, bitoff, el->bitlen, label->data, &label->len);
+        if (status != ORDPATH_SUCCESS) {
+            return status;
+        }
+    }
+    return status;
+}
+
+/*
+ * Transcode the label to the alternative setup and back, compare with
+ * ordpath_encode(). Batch and bulk versions must agree with the single
+ * one. Transcoding to the narrow setup must fail iff some component is
+ * out of range.
+ */
+static void check_transcode(ordpath_codec_t *codec,
+    const struct elabel *el, const struct label *l)
+{
+    static struct elabel t, ref, back, copies[BATCH_SIZE];
+    ordpath_codec_t *to = transcode_target(), *narrow;
+    const char *inbufs[BATCH_SIZE];
+    char *outbufs[BATCH_SIZE];
+    size_t inbitlens[BATCH_SIZE], outbitlens[BATCH_SIZE];
+    ordpath_status_t statuses[BATCH_SIZE], status, refstatus;
+    int threads;
+
+    if (ORDPATH_SUCCESS != ordpath_transcode(codec, to,
+                ELABEL_BUF(el), el->bitlen, ELABEL_BUF(&t), &t.bitlen)
+            || ORDPATH_SUCCESS != ordpath_encode(to,
+                l->data, l->len, ELABEL_BUF(&ref), &ref.bitlen)
+            || !eq_elabels(&t, &ref)) {
+        errx(EXIT_FAILURE, "Transcoding result doesn't match reference");
+    }
+    if (ORDPATH_SUCCESS != ordpath_transcode(to, codec,
+                ELABEL_BUF(&t), t.bitlen, ELABEL_BUF(&back), &back.bitlen)
+            || !eq_elabels(&back, el)) {
+        errx(EXIT_FAILURE, "Transcoding back doesn't match the label");
+    }
+
+    for (threads = 0; threads <= TRANSCODE_THREADS; threads++) {
+        for (int i = 0; i < BATCH_SIZE; i++) {
+            inbufs[i] = ELABEL_BUF(el);
+            inbitlens[i] = i % 3 == 1 ? 0 : el->bitlen;
+            outbufs[i] = ELABEL_BUF(&copies[i]);
+        }
+        status = threads == 0 ?
+            ordpath_transcode_batch(codec, to, BATCH_SIZE,
+                inbufs, inbitlens, outbufs, outbitlens, statuses) :
+            ordpath_transcode_bulk(codec, to, BATCH_SIZE,
+                inbufs, inbitlens, outbufs, outbitlens, statuses, threads);
+        if (status != ORDPATH_SUCCESS) {
+            errx(EXIT_FAILURE, "Batch transcoding failed");
+        }
+        for (int i = 0; i < BATCH_SIZE; i++) {
+            copies[i].bitlen = outbitlens[i];
+            if (statuses[i] != ORDPATH_SUCCESS || (i % 3 == 1 ?
+                        outbitlens[i] != 0 : !eq_elabels(&copies[i], &t))) {
+                errx(EXIT_FAILURE, "Batch transcoding result doesn't match");
+            }
+        }
+    }
+
+    if (ORDPATH_SUCCESS != ordpath_create(&narrow,
+                TRANSCODE_NARROW_SETUP, NULL)) {
+        errx(EXIT_FAILURE, "Failed to initialize narrow codec");
+    }
+    refstatus = ORDPATH_SUCCESS;
+    for (size_t i = 0; i < l->len; i++) {
+        if (l->data[i] < 0 || l->data[i] >= 8) {
+            refstatus = ORDPATH_OUTOFRANGE;
+        }
+    }
+    status = ordpath_transcode(codec, narrow,
+        ELABEL_BUF(el), el->bitlen, ELABEL_BUF(&t), &t.bitlen);
+    if (status != refstatus) {
+        errx(EXIT_FAILURE, "Out of range component not detected");
+    }
+    ordpath_destroy(narrow);
+}
+
+/*
+ * Self-delimiting labels. The label, its prefix, an empty label and the
+ * label again are concatenated in a single bitstream starting at an odd
+ * bit offset; the stream is split with ordpath_decode_delimited() and
+ * ordpath_skip_delimited(). Bits before the stream must be preserved,
+ * truncated streams and short buffers must be detected.
+ */
+
+#define DELIMITED_BITOFF       5
+#define DELIMITED_PIECES       4
+
+static void check_delimited(ordpath_codec_t *plain,
+    const struct elabel *el, const struct label *l)
+{
+    static struct label t;
+    ordpath_codec_t *codec = delimited_codec(), *bad;
+    size_t lens[DELIMITED_PIECES] = {l->len, l->len / 2, 0, l->len};
+    size_t bitlens[DELIMITED_PIECES], pos, end, bitlen, size, i;
+    ordpath_status_t status;
+    char *buf;
+
+    size = SZ_FROM_BITLEN(DELIMITED_BITOFF
+            + DELIMITED_PIECES * (el->bitlen + CHAR_BIT));
+    if (!(buf = malloc(size))) {
+        errx(EXIT_FAILURE, "Out of memory");
+    }
+    memset(buf, UNALIGNED_PATTERN, size);
+
+    for (i = 0, pos = DELIMITED_BITOFF; i < DELIMITED_PIECES; i++) {
+        status = ordpath_encode_delimited(codec, l->data, lens[i],
+            buf, pos, size, bitlens + i);
+        if (status != ORDPATH_SUCCESS) {
+            errx(EXIT_FAILURE, "Delimited encoding failed");
+        }
+        pos += bitlens[i];
+    }
+    end = pos;
+    for (i = 0; i < DELIMITED_BITOFF; i++) {
+        if (get_bit(buf, i)
+                != ((UNALIGNED_PATTERN >> (CHAR_BIT - 1 - i)) & 1)) {
+            errx(EXIT_FAILURE, "Delimited encoding clobbered leading bits");
+        }
+    }
+    for (i = 0; i < el->bitlen; i++) {
+        if (get_bit(buf, DELIMITED_BITOFF + i) != get_bit(ELABEL_BUF(el), i)) {
+            errx(EXIT_FAILURE, "Delimited encoding doesn't match reference");
+        }
+    }
+    if (bitlens[0] != el->bitlen + bitlens[2] || bitlens[3] != bitlens[0]) {
+        errx(EXIT_FAILURE, "Delimited label length is wrong");
+    }
+
+    /* split the stream */
+    for (i = 0, pos = DELIMITED_BITOFF; pos < end; i++) {
+        if (i == DELIMITED_PIECES) {
+            errx(EXIT_FAILURE, "Stream splitting failed");
+        }
+        if (ORDPATH_SUCCESS != ordpath_decode_delimited(codec, buf, pos,
+                    end - pos, t.data, ELABEL_BITLEN_MAX, &t.len, &bitlen)
+                || bitlen != bitlens[i] || t.len != lens[i]
+                || memcmp(t.data, l->data, t.len * sizeof t.data[0])) {
+            errx(EXIT_FAILURE, "Delimited decoding doesn't match");
+        }
+        if (ORDPATH_SUCCESS != ordpath_skip_delimited(codec, buf, pos,
+                    end - pos, &bitlen) || bitlen != bitlens[i]) {
+            errx(EXIT_FAILURE, "Skipping a delimited label failed");
+        }
+        pos += bitlen;
+    }
+    if (i != DELIMITED_PIECES) {
+        errx(EXIT_FAILURE, "Stream splitting failed");
+    }
+
+    /* truncated stream, short buffers */
+    pos = end - bitlens[3];
+    if (ordpath_decode_delimited(codec, buf, pos, bitlens[3] - 1,
+                t.data, ELABEL_BITLEN_MAX, &t.len, &bitlen)
+            != ORDPATH_CORRUPTDATA
+            || ordpath_skip_delimited(codec, buf, pos, bitlens[3] - 1,
+                &bitlen) != ORDPATH_CORRUPTDATA) {
+        errx(EXIT_FAILURE, "Truncated stream not detected");
+    }
+    if (ordpath_encode_delimited(codec, l->data, l->len, buf, pos,
+                SZ_FROM_BITLEN(end) - 1, &bitlen) != ORDPATH_BUFTOOSMALL) {
+        errx(EXIT_FAILURE, "Short output buffer not detected");
+    }
+    /* the first (partial) byte is past the buffer end */
+    if (ordpath_encode_delimited(codec, l->data, l->len, buf + size,
+                DELIMITED_BITOFF, DELIMITED_BITOFF / CHAR_BIT, &bitlen)
+            != ORDPATH_BUFTOOSMALL) {
+        errx(EXIT_FAILURE, "Short output buffer not detected");
+    }
+    if (l->len && ordpath_decode_delimited(codec, buf, pos, bitlens[3],
+                t.data, l->len - 1, &t.len, &bitlen) != ORDPATH_BUFTOOSMALL) {
+        errx(EXIT_FAILURE, "Short label buffer not detected");
+    }
+
+    /* the code is reserved */
+    if (ordpath_skip_delimited(plain, buf, pos, bitlens[3], &bitlen)
+            != ORDPATH_INVAL
+            || ordpath_decode_at(codec, buf, pos, bitlens[3],
+                t.data, &t.len) != ORDPATH_CORRUPTDATA) {
+        errx(EXIT_FAILURE, "End-of-label code not reserved");
+    }
+    if (ordpath_create(&bad, "0 : 3 : 0  1 : 3  01 : end", NULL)
+            != ORDPATH_SETUPINVAL
+            || ordpath_create(&bad, "0 : end  1 : 3 : 0  0 : end", NULL)
+            != ORDPATH_SETUPINVAL) {
+        errx(EXIT_FAILURE, "Invalid end-of-label code accepted");
+    }
+    free(buf);
+}
+
+/*
+ * Check ordpath_hash() consistency: the hash must not depend on the
+ * padding bits and the batch version must agree with the single one.
+ */
+static void check_hash(const struct elabel *el)
+{
+    static struct elabel t;
+    char *buf = ELABEL_BUF(&t);
+    const char *inbufs[2];
+    size_t inbitlens[2], size = SZ_FROM_BITLEN(el->bitlen);
+    uint64_t h, hashes[2];
+    int tailbits = el->bitlen % CHAR_BIT;
+
+    h = ordpath_hash(ELABEL_BUF(el), el->bitlen);
+
+    /* fill padding with garbage */
+    memset(buf, 0xa5, size + 2*sizeof(int64_t));
+    memcpy(buf, ELABEL_BUF(el), size);
+    if (tailbits) {
+        buf[size - 1] |= 0xff >> tailbits;
+    }
+    t.bitlen = el->bitlen;
+
+    inbufs[0] = ELABEL_BUF(el);
+    inbitlens[0] = el->bitlen;
+    inbufs[1] = buf;
+    inbitlens[1] = t.bitlen;
+    ordpath_hash_batch(2, inbufs, inbitlens, hashes);
+
+    if (h != hashes[0] || h != hashes[1]) {
+        errx(EXIT_FAILURE, "Hash is inconsistent");
+    }
+}
+
+/*
+ * Check ordpath_depth() and ordpath_parent() against the decoded label.
+ */
+static void check_levels(ordpath_codec_t *codec,
+    const struct elabel *el, const struct label *l)
+{
+    static struct label parent;
+    const char *inbufs[1] = {ELABEL_BUF(el)};
+    size_t inbitlens[1] = {el->bitlen};
+    size_t depth, parentbitlen, depths[1], parentbitlens[1];
+    size_t refdepth = 0, lastodd = 0, refparentlen = 0;
+
+    for (size_t i = 0; i < l->len; i++) {
+        if (l->data[i] & 1) {
+            refdepth++;
+            refparentlen = lastodd;
+            lastodd = i + 1;
+        }
+    }
+
+    if (ORDPATH_SUCCESS != ordpath_depth(codec,
+                ELABEL_BUF(el), el->bitlen, &depth)
+            || ORDPATH_SUCCESS != ordpath_parent(codec,
+                ELABEL_BUF(el), el->bitlen, &parentbitlen)
+            || ORDPATH_SUCCESS != ordpath_depth_batch(codec,
+                1, inbufs, inbitlens, depths, NULL)
+            || ORDPATH_SUCCESS != ordpath_parent_batch(codec,
+                1, inbufs, inbitlens, parentbitlens, NULL)) {
+        errx(EXIT_FAILURE, "Level extraction failed");
+    }
+    if (depth != refdepth || depths[0] != depth) {
+        errx(EXIT_FAILURE, "Depth doesn't match reference");
+    }
+    if (parentbitlens[0] != parentbitlen
+            || ORDPATH_SUCCESS != ordpath_decode(codec,
+                ELABEL_BUF(el), parentbitlen, parent.data, &parent.len)
+            || parent.len != refparentlen
+            || memcmp(parent.data, l->data,
+                refparentlen * sizeof l->data[0]) != 0) {
+        errx(EXIT_FAILURE, "Parent doesn't match reference");
+    }
+}
+
+/*
+ * Structural join benchmark. A synthetic document is generated (a
+ * complete tree, some nodes are labeled using carets and negative
+ * components). Candidate ancestors and descendants are subsets of the
+ * document nodes. Join over encoded labels is validated against the
+ * join over decoded labels (that is the way it was done before).
+ */
+
+struct doc {
+    size_t                     n;
+    int64_t                   *comps;   /* decoded labels */
+    size_t                    *offsets;
+    size_t                    *lens;
+    char                      *arena;   /* encoded labels */
+    const char               **bufs;
+    size_t                    *bitlens;
+};
+
+struct joinresult {
+    size_t                     count;
+    uint64_t                   checksum;
+};
+
+static int join_emit(void *ctx, size_t a, size_t d)
+{
+    struct joinresult *r = ctx;
+    r->count++;
+    r->checksum = r->checksum * 31 + a * 1000003 + d;
+    return 0;
+}
+
+static void gen_doc_node(struct doc *doc, int64_t *path, size_t len,
+    int depth, size_t *pcomps)
+{
+    size_t i = doc->n++;
+    doc->offsets[i] = *pcomps;
+    doc->lens[i] = len;
+    memcpy(doc->comps + *pcomps, path, len * sizeof path[0]);
+    *pcomps += len;
+    if (depth == JOIN_DEPTH) {
+        return;
+    }
+    for (int c = 0; c < JOIN_FANOUT; c++) {
+        int64_t v = 2*c + 1 - 2*JOIN_FANOUT;
+        if (c % 3 == 2) {
+            /* inserted between siblings c-1 and c+1 */
+            path[len] = v - 1;
+            path[len + 1] = 1;
+            gen_doc_node(doc, path, len + 2, depth + 1, pcomps);
+        } else {
+            path[len] = v;
+            gen_doc_node(doc, path, len + 1, depth + 1, pcomps);
+        }
+    }
+}
+
+static void encode_doc(struct doc *doc, ordpath_codec_t *codec, size_t ncomps)
+{
+    size_t pos = 0;
+
+    /* every component takes at most 64 bits */
+    if (posix_memalign((void **)&doc->arena, ORDPATH_BUF_ALIGNMENT,
+            (ncomps + doc->n) * sizeof(int64_t))) {
+        errx(EXIT_FAILURE, "Out of memory");
+    }
+    for (size_t i = 0; i < doc->n; i++) {
+        ordpath_status_t status;
+        doc->bufs[i] = doc->arena + pos;
+        status = ordpath_encode(codec, doc->comps + doc->offsets[i],
+            doc->lens[i], doc->arena + pos, &doc->bitlens[i]);
+        if (status != ORDPATH_SUCCESS) {
+            errx(EXIT_FAILURE, "Encoding failed");
+        }
+        pos += (SZ_FROM_BITLEN(doc->bitlens[i]) + ORDPATH_BUF_ALIGNMENT)
+            & ~(size_t)(ORDPATH_BUF_ALIGNMENT - 1);
+    }
+}
+
+static void free_doc(struct doc *doc)
+{
+    free(doc->comps);
+    free(doc->offsets);
+    free(doc->lens);
+    free(doc->bufs);
+    free(doc->bitlens);
+    free(doc->arena);
+}
+
+static void gen_doc(struct doc *doc, ordpath_codec_t *codec)
+{
+    size_t nmax = 1, t = 1, ncomps = 0;
+    int64_t path[2 * JOIN_DEPTH + 1];
+    for (int i = 0; i < JOIN_DEPTH; i++) {
+        t *= JOIN_FANOUT;
+        nmax += t;
+    }
+    doc->n = 0;
+    doc->comps = malloc(nmax * (2 * JOIN_DEPTH + 1) * sizeof path[0]);
+    doc->offsets = malloc(nmax * sizeof doc->offsets[0]);
+    doc->lens = malloc(nmax * sizeof doc->lens[0]);
+    doc->bufs = malloc(nmax * sizeof doc->bufs[0]);
+    doc->bitlens = malloc(nmax * sizeof doc->bitlens[0]);
+    if (!doc->comps || !doc->offsets || !doc->lens
+            || !doc->bufs || !doc->bitlens) {
+        errx(EXIT_FAILURE, "Out of memory");
+    }
+    path[0] = 1;
+    gen_doc_node(doc, path, 1, 1, &ncomps);
+    encode_doc(doc, codec, ncomps);
+}
+
+static int cmp_decoded(const int64_t *a, size_t alen,
+    const int64_t *b, size_t blen)
+{
+    for (size_t i = 0; i < alen && i < blen; i++) {
+        if (a[i] != b[i]) {
+            return a[i] < b[i] ? -1 : 1;
+        }
+    }
+    return (alen > blen) - (alen < blen);
+}
+
+static size_t depth_decoded(const int64_t *a, size_t alen)
+{
+    size_t depth = 0;
+    for (size_t i = 0; i < alen; i++) {
+        depth += a[i] & 1;
+    }
+    return depth;
+}
+
+/*
+ * Decode candidate lists and join them.
+ */
+static void join_decoded(ordpath_codec_t *codec, ordpath_axis_t axis,
+    const struct doc *doc, size_t na, const size_t *alist,
+    size_t nd, const size_t *dlist, struct joinresult *r)
+{
+    /* a node may appear in both lists */
+    int64_t *comps = malloc(2 * sizeof comps[0]
+        * (doc->offsets[doc->n - 1] + doc->lens[doc->n - 1]));
+    int64_t **alabels = malloc(na * sizeof alabels[0]);
+    int64_t **dlabels = malloc(nd * sizeof dlabels[0]);
+    size_t *alens = malloc(na * sizeof alens[0]);
+    size_t *dlens = malloc(nd * sizeof dlens[0]);
+    size_t *stack = malloc((na + 1) * sizeof stack[0]);
+    size_t top = 0, a = 0, d = 0, pos = 0;
+
+    if (!comps || !alabels || !dlabels || !alens || !dlens || !stack) {
+        errx(EXIT_FAILURE, "Out of memory");
+    }
+    for (size_t i = 0; i < na + nd; i++) {
+        size_t k = i < na ? alist[i] : dlist[i - na];
+        int64_t **plabel = i < na ? &alabels[i] : &dlabels[i - na];
+        size_t *plen = i < na ? &alens[i] : &dlens[i - na];
+        *plabel = comps + pos;
+        if (ORDPATH_SUCCESS != ordpath_decode(codec,
+                    doc->bufs[k], doc->bitlens[k], *plabel, plen)) {
+            errx(EXIT_FAILURE, "Decoding failed");
+        }
+        pos += *plen;
+    }
+
+    while (d < nd) {
+        int isanc = a < na && cmp_decoded(alabels[a], alens[a],
+            dlabels[d], dlens[d]) < 0;
+        const int64_t *cur = isanc ? alabels[a] : dlabels[d];
+        size_t curlen = isanc ? alens[a] : dlens[d];
+        while (top && !(alens[stack[top-1]] < curlen
+                    && cmp_decoded(alabels[stack[top-1]], alens[stack[top-1]],
+                        cur, alens[stack[top-1]]) == 0)) {
+            top--;
+        }
+        if (isanc) {
+            stack[top++] = a++;
+            continue;
+        }
+        if (axis == ORDPATH_AXIS_CHILD) {
+            if (top && depth_decoded(alabels[stack[top-1]],
+                        alens[stack[top-1]]) + 1 == depth_decoded(cur, curlen)) {
+                join_emit(r, stack[top-1], d);
+            }
+        } else {
+            for (size_t i = 0; i < top; i++) {
+                join_emit(r, stack[i], d);
+            }
+        }
+        d++;
+    }
+
+    free(comps);
+    free(alabels);
+    free(dlabels);
+    free(alens);
+    free(dlens);
+    free(stack);
+}
+
+static void join_test(ordpath_codec_t *codec, int benchmark)
+{
+    struct doc doc;
+    size_t na = 0, nd = 0, *alist, *dlist;
+    const char **abufs, **dbufs;
+    size_t *abitlens, *dbitlens;
+
+    gen_doc(&doc, codec);
+    alist = malloc(doc.n * sizeof alist[0]);
+    dlist = malloc(doc.n * sizeof dlist[0]);
+    abufs = malloc(doc.n * sizeof abufs[0]);
+    dbufs = malloc(doc.n * sizeof dbufs[0]);
+    abitlens = malloc(doc.n * sizeof abitlens[0]);
+    dbitlens = malloc(doc.n * sizeof dbitlens[0]);
+    if (!alist || !dlist || !abufs || !dbufs || !abitlens || !dbitlens) {
+        errx(EXIT_FAILURE, "Out of memory");
+    }
+    for (size_t i = 0; i < doc.n; i++) {
+        if (i % 3 == 0) {
+            abufs[na] = doc.bufs[i];
+            abitlens[na] = doc.bitlens[i];
+            alist[na++] = i;
+        }
+        if (i % 2 == 0) {
+            dbufs[nd] = doc.bufs[i];
+            dbitlens[nd] = doc.bitlens[i];
+            dlist[nd++] = i;
+        }
+    }
+
+    for (int axis = ORDPATH_AXIS_DESCENDANT; axis <= ORDPATH_AXIS_CHILD;
+            axis++) {
+        struct joinresult r1 = {0, 0}, r2 = {0, 0};
+        struct timespec ts[3];
+        ordpath_status_t status;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts[0]);
+        status = ordpath_join(codec, axis, na, abufs, abitlens,
+            nd, dbufs, dbitlens, join_emit, &r1);
+        clock_gettime(CLOCK_MONOTONIC, &ts[1]);
+        join_decoded(codec, axis, &doc, na, alist, nd, dlist, &r2);
+        clock_gettime(CLOCK_MONOTONIC, &ts[2]);
+
+        if (status != ORDPATH_SUCCESS) {
+            char errorbuf[96];
+            ordpath_strerror(status, errorbuf, sizeof errorbuf);
+            errx(EXIT_FAILURE, "Join failed: %s", errorbuf);
+        }
+        if (r1.count != r2.count || r1.checksum != r2.checksum) {
+            errx(EXIT_FAILURE, "Join result doesn't match reference");
+        }
+        if (benchmark) {
+            const char *name = axis == ORDPATH_AXIS_CHILD ?
+                "child" : "descendant";
+            printf("ordpath_join (%s, %zu x %zu nodes, %zu pairs)\n",
+                name, na, nd, r1.count);
+            printf("%-20s    %8.3lf\n", "encoded",
+                TS2D(ts[1]) - TS2D(ts[0]));
+            printf("%-20s    %8.3lf\n", "decode + join",
+                TS2D(ts[2]) - TS2D(ts[1]));
+        }
+    }
+
+    free(alist);
+    free(dlist);
+    free(abufs);
+    free(dbufs);
+    free(abitlens);
+    free(dbitlens);
+    free_doc(&doc);
+}
+
+/*
+ * Subtree bounds test. Keys are compared bytewise (like in a KV store).
+ * Document nodes are in document order, hence keys must be sorted and
+ * [lower, upper) of node X must cover exactly X and its descendants
+ * (X's subtree is the run of nodes following X having X's label as a
+ * prefix).
+ */
+
+static int cmp_keys(const char *a, size_t abitlen,
+    const char *b, size_t bbitlen)
+{
+    size_t asize = SZ_FROM_BITLEN(abitlen), bsize = SZ_FROM_BITLEN(bbitlen);
+    int t = memcmp(a, b, asize < bsize ? asize : bsize);
+    return t ? t : (asize > bsize) - (asize < bsize);
+}
+
+static void subtree_test(ordpath_codec_t *codec)
+{
+    struct doc doc;
+    char *lowers, *uppers;
+    char **plowers, **puppers;
+    size_t *lowerbitlens, *upperbitlens, stride = 0;
+
+    gen_doc(&doc, codec);
+    for (size_t i = 0; i < doc.n; i++) {
+        size_t size = SZ_FROM_BITLEN(doc.bitlens[i]);
+        stride = size > stride ? size : stride;
+    }
+    lowers = malloc(doc.n * stride);
+    uppers = malloc(doc.n * stride);
+    plowers = malloc(doc.n * sizeof plowers[0]);
+    puppers = malloc(doc.n * sizeof puppers[0]);
+    lowerbitlens = malloc(doc.n * sizeof lowerbitlens[0]);
+    upperbitlens = malloc(doc.n * sizeof upperbitlens[0]);
+    if (!lowers || !uppers || !plowers || !puppers
+            || !lowerbitlens || !upperbitlens) {
+        errx(EXIT_FAILURE, "Out of memory");
+    }
+    for (size_t i = 0; i < doc.n; i++) {
+        plowers[i] = lowers + i * stride;
+        puppers[i] = uppers + i * stride;
+    }
+    if (ORDPATH_SUCCESS != ordpath_subtree_bounds_batch(codec, doc.n,
+                doc.bufs, doc.bitlens, plowers, lowerbitlens,
+                puppers, upperbitlens)) {
+        errx(EXIT_FAILURE, "Subtree bounds failed");
+    }
+
+    for (size_t i = 0; i < doc.n; i++) {
+        const int64_t *x = doc.comps + doc.offsets[i];
+        char upper[sizeof(int64_t) * (2 * JOIN_DEPTH + 1)];
+        size_t upperbitlen, end;
+
+        if (i + 1 < doc.n && cmp_keys(doc.bufs[i], doc.bitlens[i],
+                    doc.bufs[i + 1], doc.bitlens[i + 1]) >= 0) {
+            errx(EXIT_FAILURE, "Keys are not in document order");
+        }
+        if (lowerbitlens[i] != doc.bitlens[i]
+                || cmp_keys(plowers[i], lowerbitlens[i],
+                    doc.bufs[i], doc.bitlens[i]) != 0) {
+            errx(EXIT_FAILURE, "Lower bound doesn't match the label");
+        }
+        if (ORDPATH_SUCCESS != ordpath_subtree_bounds(codec,
+                    doc.bufs[i], doc.bitlens[i], NULL, NULL,
+                    upper, &upperbitlen)
+                || upperbitlen != upperbitlens[i]
+                || cmp_keys(upper, upperbitlen,
+                    puppers[i], upperbitlens[i]) != 0) {
+            errx(EXIT_FAILURE, "Batch result doesn't match");
+        }
+
+        /* the subtree ends here */
+        end = i + 1;
+        while (end < doc.n && doc.lens[end] > doc.lens[i]
+                && memcmp(doc.comps + doc.offsets[end], x,
+                    doc.lens[i] * sizeof x[0]) == 0) {
+            end++;
+        }
+        if (upperbitlens[i] == 0 ? end != doc.n :
+                cmp_keys(doc.bufs[end - 1], doc.bitlens[end - 1],
+                    puppers[i], upperbitlens[i]) >= 0
+                || (end < doc.n && cmp_keys(doc.bufs[end], doc.bitlens[end],
+                    puppers[i], upperbitlens[i]) < 0)) {
+            errx(EXIT_FAILURE, "Subtree bounds don't match the subtree");
+        }
+    }
+
+    /* the root of the document (empty label) has no upper bound */
+    {
+        size_t lowerbitlen, upperbitlen;
+        char lower[1], upper[1];
+        if (ORDPATH_SUCCESS != ordpath_subtree_bounds(codec,
+                    doc.arena, 0, lower, &lowerbitlen, upper, &upperbitlen)
+                || lowerbitlen != 0 || upperbitlen != 0) {
+            errx(EXIT_FAILURE, "Root bounds don't match");
+        }
+    }
+
+    free(lowers);
+    free(uppers);
+    free(plowers);
+    free(puppers);
+    free(lowerbitlens);
+    free(upperbitlens);
+    free_doc(&doc);
+}
+
+/*
+ * Common prefix and LCA test. Results are validated against decoded
+ * labels for adjacent nodes (the batch is passed shifted arrays) and
+ * for pseudo-random pairs.
+ */
+static void lca_test(ordpath_codec_t *codec, int benchmark)
+{
+    static struct elabel t;
+    static struct label la, lb;
+    struct doc doc;
+    size_t *lcabitlens, checksum = 0;
+    ordpath_status_t *statuses;
+    struct timespec ts[3];
+
+    gen_doc(&doc, codec);
+    lcabitlens = malloc(doc.n * sizeof lcabitlens[0]);
+    statuses = malloc(doc.n * sizeof statuses[0]);
+    if (!lcabitlens || !statuses) {
+        errx(EXIT_FAILURE, "Out of memory");
+    }
+    clock_gettime(CLOCK_MONOTONIC, &ts[0]);
+    if (ORDPATH_SUCCESS != ordpath_lca_batch(codec, doc.n - 1,
+                doc.bufs, doc.bitlens, doc.bufs + 1, doc.bitlens + 1,
+                lcabitlens, statuses)) {
+        errx(EXIT_FAILURE, "LCA failed");
+    }
+    clock_gettime(CLOCK_MONOTONIC, &ts[1]);
+
+    /* that is the way it was done before */
+    for (size_t i = 0; i + 1 < doc.n; i++) {
+        size_t c = 0, lca = 0;
+        if (ORDPATH_SUCCESS != ordpath_decode(codec,
+                    doc.bufs[i], doc.bitlens[i], la.data, &la.len)
+                || ORDPATH_SUCCESS != ordpath_decode(codec,
+                    doc.bufs[i + 1], doc.bitlens[i + 1], lb.data, &lb.len)) {
+            errx(EXIT_FAILURE, "Decoding failed");
+        }
+        for (; c < la.len && c < lb.len && la.data[c] == lb.data[c]; c++) {
+            lca = la.data[c] & 1 ? c + 1 : lca;
+        }
+        checksum += lca;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &ts[2]);
+
+    if (benchmark) {
+        printf("ordpath_lca_batch (%zu adjacent pairs, checksum %zu)\n",
+            doc.n - 1, checksum);
+        printf("%-20s    %8.3lf\n", "encoded",
+            TS2D(ts[1]) - TS2D(ts[0]));
+        printf("%-20s    %8.3lf\n", "decode + compare",
+            TS2D(ts[2]) - TS2D(ts[1]));
+    }
+
+    for (size_t k = 0; k < 2 * (doc.n - 1); k++) {
+        size_t i = k < doc.n - 1 ? k : (k * 7919) % doc.n;
+        size_t j = k < doc.n - 1 ? k + 1 : (k * 104729) % doc.n;
+        const int64_t *a = doc.comps + doc.offsets[i];
+        const int64_t *b = doc.comps + doc.offsets[j];
+        size_t refncomps = 0, reflca = 0, ncomps, bitlen, lcabitlen;
+
+        while (refncomps < doc.lens[i] && refncomps < doc.lens[j]
+                && a[refncomps] == b[refncomps]) {
+            refncomps++;
+        }
+        for (size_t c = 0; c < refncomps; c++) {
+            reflca = a[c] & 1 ? c + 1 : reflca;
+        }
+
+        if (ORDPATH_SUCCESS != ordpath_common_prefix(codec,
+                    doc.bufs[i], doc.bitlens[i], doc.bufs[j], doc.bitlens[j],
+                    &ncomps, &bitlen)
+                || ORDPATH_SUCCESS != ordpath_lca(codec,
+                    doc.bufs[i], doc.bitlens[i], doc.bufs[j], doc.bitlens[j],
+                    &lcabitlen)) {
+            errx(EXIT_FAILURE, "LCA failed");
+        }
+        if (ncomps != refncomps
+                || ORDPATH_SUCCESS != ordpath_encode(codec,
+                    a, refncomps, ELABEL_BUF(&t), &t.bitlen)
+                || bitlen != t.bitlen) {
+            errx(EXIT_FAILURE, "Common prefix doesn't match reference");
+        }
+        if (ORDPATH_SUCCESS != ordpath_encode(codec,
+                    a, reflca, ELABEL_BUF(&t), &t.bitlen)
+                || lcabitlen != t.bitlen
+                || (k < doc.n - 1 && (statuses[k] != ORDPATH_SUCCESS
+                        || lcabitlens[k] != lcabitlen))) {
+            errx(EXIT_FAILURE, "LCA doesn't match reference");
+        }
+    }
+
+    free(lcabitlens);
+    free(statuses);
+    free_doc(&doc);
+}
+
+/*
+ * Columnar layout test. Filter results are validated against the
+ * decoded labels, every row is reconstructed and compared with the
+ * original encoded label. Both the synthetic document (narrow columns)
+ * and random labels (columns of every width) are tested.
+ */
+
+#define COLUMNS_WIDE_N         10000
+
+static uint64_t xorshift(uint64_t *state)
+{
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *state = x;
+}
+
+/*
+ * Columns 0..2 have values spanning 4, 12 and 28 bits (1, 2 and 4 byte
+ * codes), column 3 spans the whole range the codec can encode.
+ */
+static void gen_wide_doc(struct doc *doc, ordpath_codec_t *codec,
+    const struct range *r)
+{
+    uint64_t state = 88172645463325252ULL;
+    size_t ncomps = 0;
+
+    doc->n = COLUMNS_WIDE_N;
+    doc->comps = malloc(doc->n * 4 * sizeof doc->comps[0]);
+    doc->offsets = malloc(doc->n * sizeof doc->offsets[0]);
+    doc->lens = malloc(doc->n * sizeof doc->lens[0]);
+    doc->bufs = malloc(doc->n * sizeof doc->bufs[0]);
+    doc->bitlens = malloc(doc->n * sizeof doc->bitlens[0]);
+    if (!doc->comps || !doc->offsets || !doc->lens
+            || !doc->bufs || !doc->bitlens) {
+        errx(EXIT_FAILURE, "Out of memory");
+    }
+    for (size_t i = 0; i < doc->n; i++) {
+        doc->offsets[i] = ncomps;
+        doc->lens[i] = xorshift(&state) % 5;
+        for (size_t j = 0; j < doc->lens[i]; j++) {
+            static const int spanbits[] = {4, 12, 28};
+            uint64_t span = j == 3 ? (uint64_t)r->max - (uint64_t)r->min :
+                (uint64_t)1 << spanbits[j];
+            int64_t origin = j == 3 ? r->min : -(int64_t)(span / 2);
+            doc->comps[ncomps++] = (int64_t)((uint64_t)origin
+                + xorshift(&state) % span);
+        }
+    }
+    encode_doc(doc, codec, ncomps);
+}
+
+static void check_columns(ordpath_codec_t *codec, const struct doc *doc,
+    int benchmark)
+{
+    static struct label label;
+    static struct elabel el;
+    ordpath_columns_t *cols;
+    uint64_t *bitmap, *refbitmap;
+    size_t n, ncolumns, maxlen = 0, nwords = (doc->n + 63) / 64;
+    struct timespec ts[3];
+    double tfilter = 0, tdecode = 0;
+
+    for (size_t i = 0; i < doc->n; i++) {
+        maxlen = doc->lens[i] > maxlen ? doc->lens[i] : maxlen;
+    }
+
+    if (ORDPATH_SUCCESS != ordpath_columns_create(&cols, codec,
+                doc->n, doc->bufs, doc->bitlens)) {
+        errx(EXIT_FAILURE, "Failed to create columns");
+    }
+    ordpath_columns_shape(cols, &n, &ncolumns);
+    if (n != doc->n || ncolumns != maxlen) {
+        errx(EXIT_FAILURE, "Columns shape doesn't match");
+    }
+
+    bitmap = malloc(nwords * sizeof bitmap[0]);
+    refbitmap = malloc(nwords * sizeof refbitmap[0]);
+    if (!bitmap || !refbitmap) {
+        errx(EXIT_FAILURE, "Out of memory");
+    }
+
+    /* predicates: a single value, a range, everything (past the end too) */
+    for (size_t j = 0; j <= ncolumns; j++) {
+        for (int p = 0; p < 3; p++) {
+            int64_t v = j < ncolumns && doc->lens[doc->n - 1] > j ?
+                doc->comps[doc->offsets[doc->n - 1] + j] : 1;
+            int64_t min = p == 0 ? v : p == 1 ? v - 9 : INT64_MIN;
+            int64_t max = p == 0 ? v : p == 1 ? v + 1000 : INT64_MAX;
+
+            clock_gettime(CLOCK_MONOTONIC, &ts[0]);
+            if (ORDPATH_SUCCESS != ordpath_columns_filter(cols,
+                        j, min, max, bitmap)) {
+                errx(EXIT_FAILURE, "Filter failed");
+            }
+            clock_gettime(CLOCK_MONOTONIC, &ts[1]);
+
+            /* that is the way it was done before */
+            memset(refbitmap, 0, nwords * sizeof refbitmap[0]);
+            for (size_t i = 0; i < doc->n; i++) {
+                if (ORDPATH_SUCCESS != ordpath_decode(codec,
+                            doc->bufs[i], doc->bitlens[i],
+                            label.data, &label.len)) {
+                    errx(EXIT_FAILURE, "Decoding failed");
+                }
+                if (label.len > j
+                        && label.data[j] >= min && label.data[j] <= max) {
+                    refbitmap[i / 64] |= (uint64_t)1 << i % 64;
+                }
+            }
+            clock_gettime(CLOCK_MONOTONIC, &ts[2]);
+
+            if (memcmp(bitmap, refbitmap, nwords * sizeof bitmap[0]) != 0) {
+                errx(EXIT_FAILURE, "Filter result doesn't match reference");
+            }
+            tfilter += TS2D(ts[1]) - TS2D(ts[0]);
+            tdecode += TS2D(ts[2]) - TS2D(ts[1]);
+        }
+    }
+
+    for (size_t i = 0; i < doc->n; i++) {
+        if (ORDPATH_SUCCESS != ordpath_columns_get(cols,
+                    i, label.data, &label.len)
+                || label.len != doc->lens[i]
+                || memcmp(label.data, doc->comps + doc->offsets[i],
+                    label.len * sizeof label.data[0]) != 0) {
+            errx(EXIT_FAILURE, "Row doesn't match reference");
+        }
+        if (ORDPATH_SUCCESS != ordpath_columns_encode(cols,
+                    i, ELABEL_BUF(&el), &el.bitlen)
+                || el.bitlen != doc->bitlens[i]
+                || memcmp(ELABEL_BUF(&el), doc->bufs[i],
+                    SZ_FROM_BITLEN(el.bitlen)) != 0) {
+            errx(EXIT_FAILURE, "Encoded row doesn't match reference");
+        }
+    }
+
+    if (benchmark) {
+        printf("ordpath_columns_filter (%zu rows, %zu columns, %zu filters)\n",
+            n, ncolumns, 3 * (ncolumns + 1));
+        printf("%-20s    %8.3lf\n", "columns", tfilter);
+        printf("%-20s    %8.3lf\n", "decode + filter", tdecode);
+    }
+
+    free(bitmap);
+    free(refbitmap);
+    ordpath_columns_destroy(cols);
+}
+
+static void columns_test(ordpath_codec_t *codec, const struct range *r,
+    int benchmark)
+{
+    struct doc doc;
+
+    gen_doc(&doc, codec);
+    check_columns(codec, &doc, benchmark);
+    free_doc(&doc);
+
+    gen_wide_doc(&doc, codec, r);
+    check_columns(codec, &doc, benchmark);
+    free_doc(&doc);
+}
+
+/*
+ * Codec family test. Labels are encoded with a family (the setup in
+ * use plus setups tuned for wide flat lists and for carets), decoded
+ * back and compared pairwise against decoded labels. Corpora: the
+ * synthetic document, a wide flat list, random labels of every width
+ * or the given label and its prefixes. With --benchmark the number of
+ * bits is reported against the setup in use alone.
+ */
+
+#define FAMILY_LIST_N          100000
+
+/* wide flat lists: large positive components */
+#define FAMILY_WIDE_SETUP "\
+    00000   : 48     \
+    00001   : 32     \
+    0001    : 16     \
+    001     : 8      \
+    01      : 6 : 0  \
+    10      : 10     \
+    110     : 14     \
+    1110    : 20     \
+    11110   : 32     \
+    11111   : 48"
+
+/* heavy insertion: small components around zero, carets */
+#define FAMILY_CARET_SETUP "\
+    0000    : 48     \
+    0001    : 32     \
+    0010    : 16     \
+    0011    : 4      \
+    01      : 3 : -4 \
+    10      : 4      \
+    110     : 8      \
+    1110    : 16     \
+    11110   : 32     \
+    11111   : 48"
+
+static void gen_list_doc(struct doc *doc, ordpath_codec_t *codec)
+{
+    doc->n = FAMILY_LIST_N;
+    doc->comps = malloc(doc->n * 2 * sizeof doc->comps[0]);
+    doc->offsets = malloc(doc->n * sizeof doc->offsets[0]);
+    doc->lens = malloc(doc->n * sizeof doc->lens[0]);
+    doc->bufs = malloc(doc->n * sizeof doc->bufs[0]);
+    doc->bitlens = malloc(doc->n * sizeof doc->bitlens[0]);
+    if (!doc->comps || !doc->offsets || !doc->lens
+            || !doc->bufs || !doc->bitlens) {
+        errx(EXIT_FAILURE, "Out of memory");
+    }
+    for (size_t i = 0; i < doc->n; i++) {
+        doc->offsets[i] = 2 * i;
+        doc->lens[i] = 2;
+        doc->comps[2 * i] = 1;
+        doc->comps[2 * i + 1] = 2 * (int64_t)i + 1;
+    }
+    encode_doc(doc, codec, 2 * doc->n);
+}
+
+/* the label and its prefixes: len, len/2, len/4, ..., 0 */
+static void gen_prefix_doc(struct doc *doc, ordpath_codec_t *codec,
+    const struct label *l)
+{
+    size_t nmax = 2, len, ncomps = 0;
+    for (len = l->len; len; len /= 2) {
+        nmax++;
+    }
+    doc->n = 0;
+    doc->comps = malloc((2 * l->len + 1) * sizeof doc->comps[0]);
+    doc->offsets = malloc(nmax * sizeof doc->offsets[0]);
+    doc->lens = malloc(nmax * sizeof doc->lens[0]);
+    doc->bufs = malloc(nmax * sizeof doc->bufs[0]);
+    doc->bitlens = malloc(nmax * sizeof doc->bitlens[0]);
+    if (!doc->comps || !doc->offsets || !doc->lens
+            || !doc->bufs || !doc->bitlens) {
+        errx(EXIT_FAILURE, "Out of memory");
+    }
+    for (len = l->len; ; len /= 2) {
+        doc->offsets[doc->n] = ncomps;
+        doc->lens[doc->n++] = len;
+        memcpy(doc->comps + ncomps, l->data, len * sizeof l->data[0]);
+        ncomps += len;
+        if (!len) {
+            break;
+        }
+    }
+    encode_doc(doc, codec, ncomps);
+}
+
+static void check_family(ordpath_family_t *family, ordpath_codec_t *codec,
+    const struct doc *doc, const char *title, int benchmark)
+{
+    static struct label t;
+    size_t bits = 0, fbits = 0, pos = 0, bitlen;
+    char *arena, **bufs;
+    size_t *bitlens;
+    struct timespec ts[5];
+    int result;
+
+    arena = malloc(doc->n * ORDPATH_BUF_ALIGNMENT
+            + (doc->offsets[doc->n - 1] + doc->lens[doc->n - 1] + doc->n)
+            * sizeof(int64_t));
+    bufs = malloc(doc->n * sizeof bufs[0]);
+    bitlens = malloc(doc->n * sizeof bitlens[0]);
+    if (!arena || !bufs || !bitlens) {
+        errx(EXIT_FAILURE, "Out of memory");
+    }
+    for (size_t i = 0; i < doc->n; i++) {
+        bufs[i] = (char *)(((uintptr_t)(arena + pos)
+                    + ORDPATH_BUF_ALIGNMENT - 1)
+                & ~(uintptr_t)(ORDPATH_BUF_ALIGNMENT - 1));
+        pos = bufs[i] - arena + (doc->lens[i] + 1) * sizeof(int64_t);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &ts[0]);
+    for (size_t i = 0; i < doc->n; i++) {
+        ordpath_encode(codec, doc->comps + doc->offsets[i], doc->lens[i],
+            bufs[i], &bitlen);
+        bits += bitlen;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &ts[1]);
+    for (size_t i = 0; i < doc->n; i++) {
+        if (ORDPATH_SUCCESS != ordpath_family_encode(family,
+                    doc->comps + doc->offsets[i], doc->lens[i],
+                    bufs[i], &bitlens[i])) {
+            errx(EXIT_FAILURE, "Family encoding failed");
+        }
+        fbits += bitlens[i];
+    }
+    clock_gettime(CLOCK_MONOTONIC, &ts[2]);
+    for (size_t i = 0; i < doc->n; i++) {
+        ordpath_decode(codec, doc->bufs[i], doc->bitlens[i], t.data, &t.len);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &ts[3]);
+    for (size_t i = 0; i < doc->n; i++) {
+        ordpath_family_decode(family, bufs[i], bitlens[i], t.data, &t.len);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &ts[4]);
+
+    for (size_t i = 0; i < doc->n; i++) {
+        if (ORDPATH_SUCCESS != ordpath_family_decode(family,
+                    bufs[i], bitlens[i], t.data, &t.len)
+                || cmp_decoded(t.data, t.len, doc->comps + doc->offsets[i],
+                    doc->lens[i]) != 0) {
+            errx(EXIT_FAILURE, "Family decoding doesn't match");
+        }
+    }
+    for (size_t k = 0; k < 2 * doc->n; k++) {
+        size_t i = k < doc->n ? k : (k * 7919) % doc->n;
+        size_t j = k < doc->n ? (k + 1) % doc->n : (k * 104729) % doc->n;
+        int ref = cmp_decoded(
+            doc->comps + doc->offsets[i], doc->lens[i],
+            doc->comps + doc->offsets[j], doc->lens[j]);
+        if (ORDPATH_SUCCESS != ordpath_family_compare(family,
+                    bufs[i], bitlens[i], bufs[j], bitlens[j], &result)
+                || result != ref) {
+            errx(EXIT_FAILURE, "Family comparison doesn't match");
+        }
+    }
+
+    if (benchmark) {
+        printf("%s (%zu labels)\n", title, doc->n);
+        printf("%-20s    %10zu    %8.3lf    %8.3lf\n", "single setup",
+            bits, TS2D(ts[1]) - TS2D(ts[0]), TS2D(ts[3]) - TS2D(ts[2]));
+        printf("%-20s    %10zu    %8.3lf    %8.3lf    %5.1lf%% saved\n",
+            "family", fbits, TS2D(ts[2]) - TS2D(ts[1]),
+            TS2D(ts[4]) - TS2D(ts[3]), 100.0 - 100.0 * fbits / bits);
+    }
+    free(arena);
+    free(bufs);
+    free(bitlens);
+}
+
+static void family_test(ordpath_codec_t *codec, const char *setup,
+    const struct range *r, const struct label *l, int benchmark)
+{
+    const char *setups[] = {setup, FAMILY_WIDE_SETUP, FAMILY_CARET_SETUP};
+    ordpath_family_t *family;
+    struct doc doc;
+
+    if (ORDPATH_SUCCESS != ordpath_family_create(&family,
+                setups, sizeof setups / sizeof setups[0])) {
+        errx(EXIT_FAILURE, "Failed to initialize codec family");
+    }
+    if (benchmark) {
+        printf("%-20s    %10s    %8s    %8s\n", "", "bits",
+            "encode", "decode");
+    }
+
+    if (l) {
+        gen_prefix_doc(&doc, codec, l);
+        check_family(family, codec, &doc, "label", benchmark);
+        free_doc(&doc);
+    } else {
+        gen_doc(&doc, codec);
+        check_family(family, codec, &doc, "document", benchmark);
+        free_doc(&doc);
+
+        gen_list_doc(&doc, codec);
+        check_family(family, codec, &doc, "flat list", benchmark);
+        free_doc(&doc);
+
+        gen_wide_doc(&doc, codec, r);
+        check_family(family, codec, &doc, "random", benchmark);
+        free_doc(&doc);
+    }
+
+    ordpath_family_destroy(family);
+}
+
+/*
+ * Parallel decoder test. Long labels of several kinds are generated,
+ * ordpath_decode_parallel() must agree with ordpath_decode() for every
+ * thread count, on damaged labels as well (same status, same result,
+ * no components reported on error).
+ * With --benchmark the latency distribution over the labels is
+ * reported for both decoders.
+ */
+
+#define PARALLEL_LABELS        48
+#define PARALLEL_LEN_MAX       200000
+#define PARALLEL_REPEAT        8
+
+static void gen_long_label(struct label *l, const struct range *r,
+    int kind, size_t len, uint64_t *state)
+{
+    l->len = len;
+    for (size_t i = 0; i < len; i++) {
+        uint64_t x = xorshift(state);
+        switch (kind) {
+        case 0:
+            /* heavy insertion: small components, carets */
+            l->data[i] = (int64_t)(x % 33) - 16;
+            break;
+        case 1:
+            /* wide flat lists */
+            l->data[i] = (int64_t)(x % 100000) * 2 + 1;
+            break;
+        case 2:
+            /* every width */
+            l->data[i] = (int64_t)((uint64_t)r->min
+                + x % ((uint64_t)r->max - (uint64_t)r->min));
+            break;
+        default:
+            l->data[i] = (x >> 60) ? (int64_t)(x % 16) :
+                (int64_t)((uint64_t)r->min
+                    + x % ((uint64_t)r->max - (uint64_t)r->min));
+            break;
+        }
+    }
+}
+
+static int cmp_latency(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void print_latency(const char *title, double *t, size_t n)
+{
+    qsort(t, n, sizeof t[0], cmp_latency);
+    printf("%-24s    %8.3lf    %8.3lf    %8.3lf\n", title,
+        t[n / 2] * 1000.0, t[n * 99 / 100] * 1000.0, t[n - 1] * 1000.0);
+}
+
+static void parallel_test(ordpath_codec_t *codec, const struct range *r,
+    int threads, int benchmark)
+{
+    static struct label l, ref, t;
+    static double tserial[PARALLEL_LABELS * PARALLEL_REPEAT];
+    static double tparallel[PARALLEL_LABELS * PARALLEL_REPEAT];
+    uint64_t state = 88172645463325252ULL;
+    size_t bitlen, nsamples = 0;
+    ordpath_status_t status, refstatus;
+    char *buf;
+
+    if (threads <= 0) {
+        threads = TRANSCODE_THREADS;
+    }
+    if (posix_memalign((void **)&buf, ORDPATH_BUF_ALIGNMENT,
+            (PARALLEL_LEN_MAX + 1) * sizeof(int64_t))) {
+        errx(EXIT_FAILURE, "Out of memory");
+    }
+
+    for (int k = 0; k < PARALLEL_LABELS; k++) {
+        size_t len = 1000 + xorshift(&state) % (PARALLEL_LEN_MAX - 1000);
+        gen_long_label(&l, r, k % 4, len, &state);
+        if (ORDPATH_SUCCESS != ordpath_encode(codec,
+                    l.data, l.len, buf, &bitlen)) {
+            errx(EXIT_FAILURE, "Encoding failed");
+        }
+
+        for (int n = 1; n <= 8; n++) {
+            if (ORDPATH_SUCCESS != ordpath_decode_parallel(codec,
+                        buf, bitlen, t.data, &t.len, n)
+                    || !eq_labels(&t, &l)) {
+                errx(EXIT_FAILURE, "Parallel decoding doesn't match");
+            }
+        }
+
+        /* damaged labels: flipped bits, truncated labels */
+        for (int d = 0; d < 4; d++) {
+            size_t pos = xorshift(&state) % bitlen, len = bitlen;
+            if (d == 3) {
+                len = pos;
+            } else {
+                buf[pos / CHAR_BIT] ^= 1 << (CHAR_BIT - 1 - pos % CHAR_BIT);
+            }
+            refstatus = ordpath_decode(codec, buf, len, ref.data, &ref.len);
+            t.len = SIZE_MAX;
+            status = ordpath_decode_parallel(codec, buf, len,
+                t.data, &t.len, threads);
+            if (status != refstatus || (status == ORDPATH_SUCCESS
+                        ? !eq_labels(&t, &ref) : t.len != 0)) {
+                errx(EXIT_FAILURE, "Parallel decoding of a damaged label"
+                    " doesn't match");
+            }
+            if (d != 3) {
+                buf[pos / CHAR_BIT] ^= 1 << (CHAR_BIT - 1 - pos % CHAR_BIT);
+            }
+        }
+
+        if (benchmark) {
+            for (int i = 0; i < PARALLEL_REPEAT; i++) {
+                struct timespec ts[3];
+                clock_gettime(CLOCK_MONOTONIC, &ts[0]);
+                ordpath_decode(codec, buf, bitlen, t.data, &t.len);
+                clock_gettime(CLOCK_MONOTONIC, &ts[1]);
+                ordpath_decode_parallel(codec, buf, bitlen,
+                    t.data, &t.len, threads);
+                clock_gettime(CLOCK_MONOTONIC, &ts[2]);
+                tserial[nsamples] = TS2D(ts[1]) - TS2D(ts[0]);
+                tparallel[nsamples++] = TS2D(ts[2]) - TS2D(ts[1]);
+            }
+        }
+    }
+
+    if (benchmark) {
+        printf("%zu samples, %d threads, latency (ms)\n",
+            nsamples, threads);
+        printf("%-24s    %8s    %8s    %8s\n", "", "p50", "p99", "max");
+        print_latency("ordpath_decode", tserial, nsamples);
+        print_latency("ordpath_decode_parallel", tparallel, nsamples);
+    }
+    free(buf);
+}
+
+/*
+ * Label trie test. A document's labels are interned in bulk (document
+ * order), then one by one in a shuffled order; both tries must be the
+ * same after compaction (preorder numbering). Every node must
+ * materialize the label it was interned for. Some subtrees are removed
+ * and the remaining labels are checked after compaction. Corpora: the
+ * synthetic document, a deep document and random labels. With
+ * --benchmark the memory taken by the trie is reported against the
+ * encoded labels (one buffer per node) and timings.
+ */
+
+#define TRIE_DEEP_DEPTH        16
+#define TRIE_REMOVE_STEP       97
+
+static void gen_deep_node(struct doc *doc, int64_t *path, size_t len,
+    size_t *pcomps)
+{
+    size_t i = doc->n++;
+    doc->offsets[i] = *pcomps;
+    doc->lens[i] = len;
+    memcpy(doc->comps + *pcomps, path, len * sizeof path[0]);
+    *pcomps += len;
+    if (len == TRIE_DEEP_DEPTH) {
+        return;
+    }
+    for (int c = 0; c < 2; c++) {
+        path[len] = 2 * (int64_t)(c + len * len) + 1;
+        gen_deep_node(doc, path, len + 1, pcomps);
+    }
+}
+
+/* binary tree, the labels are TRIE_DEEP_DEPTH-1 components long on average */
+static void gen_deep_doc(struct doc *doc, ordpath_codec_t *codec)
+{
+    size_t nmax = ((size_t)1 << TRIE_DEEP_DEPTH) - 1, ncomps = 0;
+    int64_t path[TRIE_DEEP_DEPTH];
+
+    doc->n = 0;
+    doc->comps = malloc(nmax * TRIE_DEEP_DEPTH * sizeof path[0]);
+    doc->offsets = malloc(nmax * sizeof doc->offsets[0]);
+    doc->lens = malloc(nmax * sizeof doc->lens[0]);
+    doc->bufs = malloc(nmax * sizeof doc->bufs[0]);
+    doc->bitlens = malloc(nmax * sizeof doc->bitlens[0]);
+    if (!doc->comps || !doc->offsets || !doc->lens
+            || !doc->bufs || !doc->bitlens) {
+        errx(EXIT_FAILURE, "Out of memory");
+    }
+    path[0] = 1;
+    gen_deep_node(doc, path, 1, &ncomps);
+    encode_doc(doc, codec, ncomps);
+}
+
+static void check_trie_node(const ordpath_trie_t *trie, size_t node,
+    const struct doc *doc, size_t i)
+{
+    static struct label t;
+    static int64_t buf [LABEL_LEN_MAX + 1];
+    size_t bitlen;
+
+    if (ORDPATH_SUCCESS != ordpath_trie_label(trie, node, t.data, &t.len)
+            || cmp_decoded(t.data, t.len, doc->comps + doc->offsets[i],
+                doc->lens[i]) != 0
+            || ordpath_trie_depth(trie, node) != doc->lens[i]) {
+        errx(EXIT_FAILURE, "Trie label doesn't match");
+    }
+    if (ORDPATH_SUCCESS != ordpath_trie_encode(trie, node,
+                (char *)buf, &bitlen)
+            || bitlen != doc->bitlens[i]
+            || memcmp(buf, doc->bufs[i], SZ_FROM_BITLEN(bitlen)) != 0) {
+        errx(EXIT_FAILURE, "Trie encoding doesn't match");
+    }
+    if (node != ORDPATH_TRIE_ROOT && ordpath_trie_depth(trie,
+                ordpath_trie_parent(trie, node)) + 1 != doc->lens[i]) {
+        errx(EXIT_FAILURE, "Trie parent doesn't match");
+    }
+}
+
+static int64_t trie_component(const ordpath_trie_t *trie, size_t node)
+{
+    int64_t component;
+    if (ORDPATH_SUCCESS != ordpath_trie_component(trie, node, &component)) {
+        errx(EXIT_FAILURE, "Trie node is invalid");
+    }
+    return component;
+}
+
+/* removed and out of range nodes are rejected */
+static void check_trie_invalid(const ordpath_trie_t *trie, size_t node)
+{
+    int64_t component;
+    if (ordpath_trie_parent(trie, node) != ORDPATH_TRIE_NONE
+            || ordpath_trie_first_child(trie, node) != ORDPATH_TRIE_NONE
+            || ordpath_trie_next_sibling(trie, node) != ORDPATH_TRIE_NONE
+            || ordpath_trie_depth(trie, node) != ORDPATH_TRIE_NONE
+            || ordpath_trie_component(trie, node, &component)
+                != ORDPATH_INVAL) {
+        errx(EXIT_FAILURE, "Invalid trie node accepted");
+    }
+}
+
+/* preorder numbering, siblings in document order */
+static void check_trie_shape(const ordpath_trie_t *trie)
+{
+    size_t nnodes, nlive, bytes;
+    ordpath_trie_shape(trie, &nnodes, &nlive, &bytes);
+    if (nnodes != nlive) {
+        errx(EXIT_FAILURE, "Trie isn't compact");
+    }
+    for (size_t p = 0; p < nnodes; p++) {
+        size_t c = ordpath_trie_first_child(trie, p), s;
+        if (c != ORDPATH_TRIE_NONE && c != p + 1) {
+            errx(EXIT_FAILURE, "Trie isn't in preorder");
+        }
+        for (; c != ORDPATH_TRIE_NONE; c = s) {
+            s = ordpath_trie_next_sibling(trie, c);
+            if (ordpath_trie_parent(trie, c) != p
+                    || (s != ORDPATH_TRIE_NONE
+                        && trie_component(trie, c)
+                            >= trie_component(trie, s))) {
+                errx(EXIT_FAILURE, "Trie links are broken");
+            }
+        }
+    }
+}
+
+/*
+ * A node is dead if it or an ancestor was removed. Parents are saved
+ * before removal, removed nodes have no links.
+ */
+static int trie_dead(const size_t *parents, const char *removed,
+    size_t node)
+{
+    for (; node != ORDPATH_TRIE_NONE; node = parents[node]) {
+        if (removed[node]) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void check_trie(ordpath_codec_t *codec, const struct doc *doc,
+    const char *title, int benchmark)
+{
+    static struct label t;
+    ordpath_trie_t *trie, *trie2;
+    size_t *nodes, *order, *remap, *parents, nnodes, nlive, bytes, nnodes2, nlive2,
+        bytes2, tbytes, node, ebytes = 0;
+    char *removed;
+    uint64_t state = 88172645463325252ULL;
+    struct timespec ts[5];
+
+    nodes = malloc(doc->n * sizeof nodes[0]);
+    order = malloc(doc->n * sizeof order[0]);
+    if (!nodes || !order) {
+        errx(EXIT_FAILURE, "Out of memory");
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &ts[0]);
+    if (ORDPATH_SUCCESS != ordpath_trie_create(&trie, codec, doc->n,
+                doc->bufs, doc->bitlens, nodes)) {
+        errx(EXIT_FAILURE, "Failed to build trie");
+    }
+    clock_gettime(CLOCK_MONOTONIC, &ts[1]);
+    for (size_t i = 0; i < doc->n; i++) {
+        ordpath_trie_encode(trie, nodes[i], (char *)t.data, &node);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &ts[2]);
+    for (size_t i = 0; i < doc->n; i++) {
+        check_trie_node(trie, nodes[i], doc, i);
+        ebytes += (SZ_FROM_BITLEN(doc->bitlens[i])
+                + ORDPATH_BUF_ALIGNMENT - 1)
+            & ~(size_t)(ORDPATH_BUF_ALIGNMENT - 1);
+    }
+    ordpath_trie_shape(trie, &nnodes, &nlive, &bytes);
+
+    /* interning again finds the same nodes */
+    for (size_t i = 0; i < doc->n; i++) {
+        if (ORDPATH_SUCCESS != ordpath_trie_intern(trie,
+                    doc->bufs[i], doc->bitlens[i], &node)
+                || node != nodes[i]) {
+            errx(EXIT_FAILURE, "Trie interning doesn't match");
+        }
+    }
+    ordpath_trie_shape(trie, &nnodes2, &nlive2, &bytes2);
+    if (nnodes2 != nnodes || nlive2 != nlive) {
+        errx(EXIT_FAILURE, "Trie grew");
+    }
+
+    /* shuffled order, one by one */
+    for (size_t i = 0; i < doc->n; i++) {
+        size_t j = xorshift(&state) % (i + 1);
+        order[i] = order[j];
+        order[j] = i;
+    }
+    if (ORDPATH_SUCCESS != ordpath_trie_create(&trie2, codec, 0,
+                NULL, NULL, NULL)) {
+        errx(EXIT_FAILURE, "Failed to create trie");
+    }
+    clock_gettime(CLOCK_MONOTONIC, &ts[3]);
+    for (size_t i = 0; i < doc->n; i++) {
+        if (ORDPATH_SUCCESS != ordpath_trie_intern(trie2,
+                    doc->bufs[order[i]], doc->bitlens[order[i]], &node)) {
+            errx(EXIT_FAILURE, "Trie interning failed");
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &ts[4]);
+
+    /* compacted tries are the same */
+    if (ORDPATH_SUCCESS != ordpath_trie_compact(trie, NULL)
+            || ORDPATH_SUCCESS != ordpath_trie_compact(trie2, NULL)) {
+        errx(EXIT_FAILURE, "Trie compaction failed");
+    }
+    check_trie_shape(trie);
+    check_trie_shape(trie2);
+    ordpath_trie_shape(trie, &nnodes, &nlive, &tbytes);
+    ordpath_trie_shape(trie2, &nnodes2, &nlive2, &bytes2);
+    if (nnodes2 != nlive) {
+        errx(EXIT_FAILURE, "Trie sizes don't match");
+    }
+    for (size_t p = 0; p < nnodes2; p++) {
+        if (trie_component(trie, p) != trie_component(trie2, p)
+                || ordpath_trie_parent(trie, p)
+                    != ordpath_trie_parent(trie2, p)
+                || ordpath_trie_next_sibling(trie, p)
+                    != ordpath_trie_next_sibling(trie2, p)) {
+            errx(EXIT_FAILURE, "Tries don't match");
+        }
+    }
+    ordpath_trie_destroy(trie2);
+
+    /* remove some subtrees, node ids are stable until compaction */
+    for (size_t i = 0; i < doc->n; i++) {
+        if (ORDPATH_SUCCESS != ordpath_trie_intern(trie,
+                    doc->bufs[i], doc->bitlens[i], &nodes[i])) {
+            errx(EXIT_FAILURE, "Trie interning failed");
+        }
+    }
+    if (ordpath_trie_remove(trie, ORDPATH_TRIE_ROOT) == ORDPATH_SUCCESS) {
+        errx(EXIT_FAILURE, "Trie root removed");
+    }
+    ordpath_trie_shape(trie, &nnodes, &nlive, &bytes);
+    removed = calloc(nnodes, 1);
+    remap = malloc(nnodes * sizeof remap[0]);
+    parents = malloc(nnodes * sizeof parents[0]);
+    if (!removed || !remap || !parents) {
+        errx(EXIT_FAILURE, "Out of memory");
+    }
+    for (size_t p = 0; p < nnodes; p++) {
+        parents[p] = ordpath_trie_parent(trie, p);
+    }
+    for (size_t i = 1; i < doc->n; i += TRIE_REMOVE_STEP) {
+        if (nodes[i] != ORDPATH_TRIE_ROOT
+                && !trie_dead(parents, removed, nodes[i])) {
+            if (ORDPATH_SUCCESS != ordpath_trie_remove(trie, nodes[i])) {
+                errx(EXIT_FAILURE, "Trie removal failed");
+            }
+            removed[nodes[i]] = 1;
+        }
+    }
+    for (size_t i = 0; i < doc->n; i++) {
+        order[i] = trie_dead(parents, removed, nodes[i]);
+        if (order[i]) {
+            check_trie_invalid(trie, nodes[i]);
+        }
+    }
+    check_trie_invalid(trie, nnodes);
+    if (ORDPATH_SUCCESS != ordpath_trie_compact(trie, remap)) {
+        errx(EXIT_FAILURE, "Trie compaction failed");
+    }
+    check_trie_shape(trie);
+    for (size_t i = 0; i < doc->n; i++) {
+        node = remap[nodes[i]];
+        if ((node == ORDPATH_TRIE_NONE) != order[i]) {
+            errx(EXIT_FAILURE, "Trie removal doesn't match");
+        }
+        if (node != ORDPATH_TRIE_NONE) {
+            check_trie_node(trie, node, doc, i);
+        }
+    }
+
+    if (benchmark) {
+        printf("%-12s    %8zu    %6.1lf    %6.1lf    %8.3lf    %8.3lf"
+            "    %8.3lf\n", title, doc->n,
+            (double)ebytes / doc->n, (double)tbytes / doc->n,
+            TS2D(ts[1]) - TS2D(ts[0]), TS2D(ts[4]) - TS2D(ts[3]),
+            TS2D(ts[2]) - TS2D(ts[1]));
+    }
+    ordpath_trie_destroy(trie);
+    free(nodes);
+    free(order);
+    free(remap);
+    free(parents);
+    free(removed);
+}
+
+static void trie_test(ordpath_codec_t *codec, const struct range *r,
+    int benchmark)
+{
+    struct doc doc;
 
-#define BENCHMARK_LOOP_DO_NOT_OPTIMIZE() \
-    do { asm volatile ("":::"memory"); } while (0)
+    if (benchmark) {
+        printf("%-12s    %8s    %6s    %6s    %8s    %8s    %8s\n", "",
+            "labels", "B/elab", "B/trie", "build", "intern", "encode");
+    }
 
-#define TS2D(ts) \
-    ((double)ts.tv_sec + (double)ts.tv_nsec/1000000000.0)
+    gen_doc(&doc, codec);
+    check_trie(codec, &doc, "document", benchmark);
+    free_doc(&doc);
+
+    gen_deep_doc(&doc, codec);
+    check_trie(codec, &doc, "deep", benchmark);
+    free_doc(&doc);
+
+    gen_wide_doc(&doc, codec, r);
+    check_trie(codec, &doc, "random", benchmark);
+    free_doc(&doc);
+}
 
 /*
- * Structures
+ * Decoded label cache test. Labels of the synthetic document are
+ * accessed with a skewed pattern (most accesses hit the top levels,
+ * the rest are uniform) through ordpath_decode_cached() and compared
+ * with the document. Caches of several sizes are tried, with and
+ * without the prefix cache; the small one is also shared by several
+ * threads. With --benchmark the time is reported against
+ * ordpath_decode() along with the hit rates.
  */
 
-struct range {
-    int64_t                    min;
-    int64_t                    max;
-};
-
-struct label {
-    size_t                     len;
-    int64_t                    data[ELABEL_BITLEN_MAX];
-};
+#define CACHE_ACCESSES         (1 << 20)
+#define CACHE_HOT_DEPTH        3
+#define CACHE_HOT_PERCENT      90
+#define CACHE_LARGE            (64 << 20)
+#define CACHE_SMALL            (256 << 10)
+#define CACHE_BYPASS_BITS      64      /* shorter labels aren't looked up */
 
-struct elabel {
-    size_t                     bitlen;
-    char                       padding [ORDPATH_BUF_ALIGNMENT];
-    char                       reserved [SZ_FROM_BITLEN(ELABEL_BITLEN_MAX)];
+struct cachejob {
+    ordpath_cache_t           *cache;
+    const struct doc          *doc;
+    const size_t              *accesses;
+    size_t                     n;
+    pthread_t                  thread;
 };
 
-#define ELABEL_BUF(e) \
-    (char *)((uintptr_t)(e)->reserved & ~(uintptr_t)(ORDPATH_BUF_ALIGNMENT-1))
+static void gen_accesses(const struct doc *doc, size_t *accesses, size_t n,
+    uint64_t state)
+{
+    size_t *hot, nhot = 0;
 
-/*
- * Helper functions
- */
+    if (!(hot = malloc(doc->n * sizeof hot[0]))) {
+        errx(EXIT_FAILURE, "Out of memory");
+    }
+    for (size_t i = 0; i < doc->n; i++) {
+        if (doc->lens[i] <= CACHE_HOT_DEPTH) {
+            hot[nhot++] = i;
+        }
+    }
+    for (size_t k = 0; k < n; k++) {
+        uint64_t x = xorshift(&state);
+        accesses[k] = x % 100 < CACHE_HOT_PERCENT ?
+            hot[(x >> 8) % nhot] : (x >> 8) % doc->n;
+    }
+    free(hot);
+}
 
-static void read_setup(const char *name, char setup[SETUP_LEN_MAX])
+static void *cache_worker(void *arg)
 {
-    FILE *file;
-    size_t size;
-    if (!(file = fopen(name, "rt"))) {
-        err(EXIT_FAILURE, "Error opening \"%s\"", name);
+    struct cachejob *job = arg;
+    struct label *t;
+
+    if (!(t = malloc(sizeof *t))) {
+        errx(EXIT_FAILURE, "Out of memory");
     }
-    size = fread(setup, 1, SETUP_LEN_MAX - 1, file);
-    setup[size] = 0;
-    if (strlen(setup) != size || !feof(file)) {
-        errx(EXIT_FAILURE, "Bad setup \"%s\"", name);
+    for (size_t k = 0; k < job->n; k++) {
+        size_t i = job->accesses[k];
+        if (ORDPATH_SUCCESS != ordpath_decode_cached(job->cache,
+                    job->doc->bufs[i], job->doc->bitlens[i], t->data, &t->len)
+                || cmp_decoded(t->data, t->len,
+                    job->doc->comps + job->doc->offsets[i],
+                    job->doc->lens[i]) != 0) {
+            errx(EXIT_FAILURE, "Cached decoding doesn't match");
+        }
     }
-    fclose(file);
+    free(t);
+    return NULL;
 }
 
-static int eq_labels(const struct label *l1, const struct label *l2)
+static uint64_t count_lookups(const struct doc *doc, const size_t *accesses,
+    size_t n)
 {
-    return l1->len == l2->len
-        && memcmp(l1->data, l2->data, l1->len * sizeof l1->data[0]) == 0;
+    uint64_t nlookups = 0;
+    for (size_t k = 0; k < n; k++) {
+        nlookups += doc->bitlens[accesses[k]] > CACHE_BYPASS_BITS;
+    }
+    return nlookups;
 }
 
-static void read_label(struct label *label, FILE *file, const struct range *r)
+static void check_cache(ordpath_codec_t *codec, const struct doc *doc,
+    const size_t *accesses, size_t maxbytes, int flags, int threads,
+    const char *title, int benchmark)
 {
-    int64_t c;
-    for (size_t i=0; i<LABEL_LEN_MAX; i++) {
-        if (1 != fscanf(file, "%"SCNd64" ", &c)) {
-            if (!feof(file)) {
-                errx(EXIT_FAILURE, "Bad label");
-            }
-            label->len = i;
-            return;
+    static struct label t;
+    struct cachejob jobs [BULK_THREADS_MAX];
+    ordpath_cache_t *cache;
+    uint64_t hits, misses, prefixhits, nlookups;
+    size_t bytes;
+    struct timespec ts[3];
+
+    if (ORDPATH_SUCCESS != ordpath_cache_create(&cache, codec,
+                maxbytes, flags)) {
+        errx(EXIT_FAILURE, "Failed to create cache");
+    }
+    jobs[0].cache = cache;
+    jobs[0].doc = doc;
+    jobs[0].accesses = accesses;
+    jobs[0].n = CACHE_ACCESSES;
+    cache_worker(jobs);
+    ordpath_cache_stats(cache, &hits, &misses, &prefixhits, &bytes);
+    nlookups = count_lookups(doc, accesses, CACHE_ACCESSES);
+    if (hits + misses + prefixhits != nlookups
+            || bytes > maxbytes || hits == 0
+            || ((flags & ORDPATH_CACHE_PREFIX) != 0) != (prefixhits != 0)) {
+        errx(EXIT_FAILURE, "Unexpected cache stats");
+    }
+
+    if (benchmark) {
+        clock_gettime(CLOCK_MONOTONIC, &ts[0]);
+        for (size_t k = 0; k < CACHE_ACCESSES; k++) {
+            size_t i = accesses[k];
+            ordpath_decode(codec, doc->bufs[i], doc->bitlens[i],
+                t.data, &t.len);
         }
-        if (c < r->min || c > r->max) {
-            errx(EXIT_FAILURE,
-                "Label component %"PRId64" "
-                "not in valid range [%"PRId64",%"PRId64"]",
-                c, r->min, r->max);
+        clock_gettime(CLOCK_MONOTONIC, &ts[1]);
+        for (size_t k = 0; k < CACHE_ACCESSES; k++) {
+            size_t i = accesses[k];
+            ordpath_decode_cached(cache, doc->bufs[i], doc->bitlens[i],
+                t.data, &t.len);
         }
-        label->data[i] = c;
+        clock_gettime(CLOCK_MONOTONIC, &ts[2]);
+        printf("%-16s    %10zu    %5.1lf%%    %5.1lf%%    %8.3lf    %8.3lf\n",
+            title, bytes, 100.0 * hits / nlookups,
+            100.0 * prefixhits / nlookups,
+            TS2D(ts[1]) - TS2D(ts[0]), TS2D(ts[2]) - TS2D(ts[1]));
     }
-    errx(EXIT_FAILURE, "Label too long");
+
+    /* shared by several threads, each one has its own access pattern */
+    for (int j = 0; j < threads; j++) {
+        jobs[j].cache = cache;
+        jobs[j].doc = doc;
+        jobs[j].accesses = accesses + (size_t)j * CACHE_ACCESSES;
+        jobs[j].n = CACHE_ACCESSES;
+        if (pthread_create(&jobs[j].thread, NULL, cache_worker, jobs + j)) {
+            errx(EXIT_FAILURE, "Failed to create thread");
+        }
+    }
+    for (int j = 0; j < threads; j++) {
+        pthread_join(jobs[j].thread, NULL);
+    }
+    if (benchmark) {
+        nlookups *= 2;
+    }
+    for (int j = 0; j < threads; j++) {
+        nlookups += count_lookups(doc, jobs[j].accesses, CACHE_ACCESSES);
+    }
+    ordpath_cache_stats(cache, &hits, &misses, &prefixhits, &bytes);
+    if (hits + misses + prefixhits != nlookups) {
+        errx(EXIT_FAILURE, "Unexpected cache stats");
+    }
+    ordpath_cache_destroy(cache);
 }
 
-static void write_label(const struct label *label, FILE *file)
+static void cache_test(ordpath_codec_t *codec, int threads, int benchmark)
 {
-    for (size_t i=0; i < label->len; i++) {
-        fprintf(file, "%"PRId64"\n", label->data[i]);
+    struct doc doc;
+    size_t *accesses;
+
+    if (threads <= 0) {
+        threads = TRANSCODE_THREADS;
     }
+    threads = threads < BULK_THREADS_MAX ? threads : BULK_THREADS_MAX;
+    gen_doc(&doc, codec);
+    accesses = malloc((size_t)threads * CACHE_ACCESSES
+            * sizeof accesses[0]);
+    if (!accesses) {
+        errx(EXIT_FAILURE, "Out of memory");
+    }
+    for (int j = 0; j < threads; j++) {
+        gen_accesses(&doc, accesses + (size_t)j * CACHE_ACCESSES,
+            CACHE_ACCESSES, 88172645463325252ULL + j);
+    }
+
+    if (benchmark) {
+        printf("%-16s    %10s    %6s    %6s    %8s    %8s\n", "",
+            "bytes", "hits", "prefix", "decode", "cached");
+    }
+    check_cache(codec, &doc, accesses, CACHE_LARGE, 0, threads,
+        "large", benchmark);
+    check_cache(codec, &doc, accesses, CACHE_SMALL, 0, threads,
+        "small", benchmark);
+    check_cache(codec, &doc, accesses, CACHE_SMALL, ORDPATH_CACHE_PREFIX,
+        threads, "small, prefix", benchmark);
+
+    free(accesses);
+    free_doc(&doc);
 }
 
-static int eq_elabels(const struct elabel *el1, const struct elabel *el2)
+/*
+ * Bulk mode. Input file is mapped into memory and split into records:
+ * either labels, one label per line (components separated by
+ * whitespace), or encoded labels stored one after another (the usual
+ * format, see read_elabel()). Records are split among worker threads,
+ * every worker renders its part of the output into a memory buffer.
+ * Buffers are written to the output file in order.
+ */
+
+struct bulkrec {
+    const char                *p;
+    size_t                     size;
+    size_t                     bitlen;  /* encoded labels only */
+};
+
+struct bulkfile {
+    const char                *data;
+    size_t                     size;
+    struct bulkrec            *recs;
+    size_t                     n;
+};
+
+struct bulkjob {
+    ordpath_codec_t           *codec;
+    const struct range        *r;
+    int                        encode;
+    const struct bulkrec      *recs;
+    const struct bulkrec      *refrecs;
+    size_t                     n;
+    char                      *out;
+    size_t                     outsize;
+    size_t                     outcap;
+    size_t                     ncomps;
+    pthread_t                  thread;
+};
+
+static void *xrealloc(void *p, size_t size)
 {
-    return el1->bitlen == el2->bitlen
-        && memcmp(ELABEL_BUF(el1), ELABEL_BUF(el2), SZ_FROM_BITLEN(el1->bitlen)) == 0;
+    if (!(p = realloc(p, size))) {
+        errx(EXIT_FAILURE, "Out of memory");
+    }
+    return p;
 }
 
-static void read_elabel(struct elabel *elabel, FILE *file)
+static void bulk_map(struct bulkfile *f, FILE *file, const char *name)
 {
-    char buf[64];
-    size_t size, bitlen;
-    if (!fgets(buf, sizeof buf, file) || !strchr(buf, '\n')) {
-        goto badlabel;
+    struct stat st;
+    if (fstat(fileno(file), &st) != 0 || !S_ISREG(st.st_mode)) {
+        errx(EXIT_FAILURE, "Bulk mode needs a regular file (%s)", name);
     }
-    if (1 != sscanf(buf, "%zu", &bitlen)) {
-        goto badlabel;
+    f->size = st.st_size;
+    f->data = "";
+    if (f->size && MAP_FAILED == (f->data = mmap(NULL, f->size,
+                    PROT_READ, MAP_PRIVATE, fileno(file), 0))) {
+        err(EXIT_FAILURE, "Unable to map %s", name);
     }
-    if (bitlen > ELABEL_BITLEN_MAX) {
-        errx(EXIT_FAILURE, "Encoded label too long");
+    f->recs = NULL;
+    f->n = 0;
+}
+
+static void bulk_unmap(struct bulkfile *f)
+{
+    if (f->size) {
+        munmap((void *)f->data, f->size);
     }
-    size = SZ_FROM_BITLEN(bitlen);
-    if (size != fread(ELABEL_BUF(elabel), 1, size, file)) {
-        goto badlabel;
+    free(f->recs);
+}
+
+static void bulk_add(struct bulkfile *f, const char *p, size_t size,
+    size_t bitlen)
+{
+    if ((f->n & (f->n - 1)) == 0) {
+        f->recs = xrealloc(f->recs, (f->n ? 2 * f->n : 1) * sizeof f->recs[0]);
     }
-    elabel->bitlen = bitlen;
-    return;
-badlabel:
-    errx(EXIT_FAILURE, "Bad encoded label");
+    f->recs[f->n].p = p;
+    f->recs[f->n].size = size;
+    f->recs[f->n].bitlen = bitlen;
+    f->n++;
 }
 
-static void write_elabel(const struct elabel *elabel, FILE *file)
+static void bulk_split_labels(struct bulkfile *f)
 {
-    fprintf(file, "%-15zu\n", elabel->bitlen);
-    fwrite(ELABEL_BUF(elabel), 1, SZ_FROM_BITLEN(elabel->bitlen), file);
+    const char *p = f->data, *end = f->data + f->size;
+    while (p < end) {
+        const char *eol = memchr(p, '\n', end - p);
+        eol = eol ? eol : end;
+        bulk_add(f, p, eol - p, 0);
+        p = eol + 1;
+    }
 }
 
-static void memcpy_benchmark(int n, const struct label *l)
+static void bulk_split_elabels(struct bulkfile *f, const char *name)
 {
-    static struct label t;
-    int i;
-    for (i=0; i<n; i++) {
-        memcpy(t.data, l->data, l->len * sizeof l->data[0]);
+    const char *p = f->data, *end = f->data + f->size;
+    while (p < end) {
+        char header[ELABEL_HEADER_SIZE + 1];
+        size_t bitlen;
+        if ((size_t)(end - p) < ELABEL_HEADER_SIZE) {
+            errx(EXIT_FAILURE, "Bad encoded label (%s)", name);
+        }
+        memcpy(header, p, ELABEL_HEADER_SIZE);
+        header[ELABEL_HEADER_SIZE] = 0;
+        if (header[ELABEL_HEADER_SIZE - 1] != '\n'
+                || 1 != sscanf(header, "%zu", &bitlen)
+                || SZ_FROM_BITLEN(bitlen)
+                    > (size_t)(end - p) - ELABEL_HEADER_SIZE) {
+            errx(EXIT_FAILURE, "Bad encoded label (%s)", name);
+        }
+        bulk_add(f, p + ELABEL_HEADER_SIZE, SZ_FROM_BITLEN(bitlen), bitlen);
+        p += ELABEL_HEADER_SIZE + SZ_FROM_BITLEN(bitlen);
+    }
+}
 
-        BENCHMARK_LOOP_DO_NOT_OPTIMIZE();
+static char *bulk_reserve(struct bulkjob *job, size_t size)
+{
+    if (job->outcap - job->outsize < size) {
+        job->outcap = 2 * job->outcap > job->outsize + size ?
+            2 * job->outcap : job->outsize + size;
+        job->out = xrealloc(job->out, job->outcap);
     }
+    return job->out + job->outsize;
 }
 
-static void encoding_benchmark(int n, const struct label *l,
-    ordpath_codec_t *codec)
+static size_t bulk_parse_label(const struct bulkrec *rec,
+    const struct range *r, int64_t **plabel, size_t *pcap)
 {
-    static struct elabel et;
-    int i;
-    for (i=0; i<n; i++) {
-        ordpath_encode(codec, l->data, l->len, ELABEL_BUF(&et), &et.bitlen);
+    const char *p = rec->p, *end = rec->p + rec->size;
+    size_t len = 0;
+    while (1) {
+        uint64_t v = 0;
+        int neg = 0, digits = 0;
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) {
+            p++;
+        }
+        if (p == end) {
+            return len;
+        }
+        if (*p == '-') {
+            neg = 1;
+            p++;
+        }
+        for (; p < end && *p >= '0' && *p <= '9' && digits < 19; digits++) {
+            v = v * 10 + (*p++ - '0');
+        }
+        if (!digits || (p < end && *p != ' ' && *p != '\t' && *p != '\r')) {
+            errx(EXIT_FAILURE, "Bad label");
+        }
+        if (v > (uint64_t)INT64_MAX
+                || (neg ? -(int64_t)v < r->min : (int64_t)v > r->max)) {
+            errx(EXIT_FAILURE, "Label component not in valid range");
+        }
+        if (len == *pcap) {
+            *pcap = *pcap ? 2 * *pcap : 64;
+            *plabel = xrealloc(*plabel, *pcap * sizeof (*plabel)[0]);
+        }
+        (*plabel)[len++] = neg ? -(int64_t)v : (int64_t)v;
+    }
+}
 
-        BENCHMARK_LOOP_DO_NOT_OPTIMIZE();
+static void *bulk_worker(void *arg)
+{
+    struct bulkjob *job = arg;
+    int64_t *label = NULL, *ref = NULL;
+    size_t labelcap = 0, refcap = 0, len, reflen;
+    ordpath_status_t status;
+
+    for (size_t i = 0; i < job->n; i++) {
+        const struct bulkrec *rec = job->recs + i;
+        const struct bulkrec *refrec = job->refrecs ? job->refrecs + i : NULL;
+
+        if (job->encode) {
+            /* encode straight into the output buffer */
+            size_t cap, bitlen;
+            char *out, header[ELABEL_HEADER_SIZE + 1];
+            len = bulk_parse_label(rec, job->r, &label, &labelcap);
+            cap = (len + 1) * sizeof(int64_t);
+            out = bulk_reserve(job, ELABEL_HEADER_SIZE + cap);
+            status = ordpath_encode_exact(job->codec, label, len,
+                out + ELABEL_HEADER_SIZE, cap, &bitlen);
+            if (status != ORDPATH_SUCCESS) {
+                errx(EXIT_FAILURE, "Encoding failed");
+            }
+            snprintf(header, sizeof header, "%-15zu\n", bitlen);
+            memcpy(out, header, ELABEL_HEADER_SIZE);
+            if (refrec && (refrec->bitlen != bitlen
+                        || memcmp(refrec->p, out + ELABEL_HEADER_SIZE,
+                            SZ_FROM_BITLEN(bitlen)) != 0)) {
+                errx(EXIT_FAILURE, "Result doesn't match reference data");
+            }
+            job->outsize += ELABEL_HEADER_SIZE + SZ_FROM_BITLEN(bitlen);
+        } else {
+            /* decode straight from the mapped file */
+            char *out;
+            if (rec->bitlen + 1 > labelcap) {
+                labelcap = rec->bitlen + 1;
+                label = xrealloc(label, labelcap * sizeof label[0]);
+            }
+            status = ordpath_decode_at(job->codec,
+                rec->p, 0, rec->bitlen, label, &len);
+            if (status != ORDPATH_SUCCESS) {
+                errx(EXIT_FAILURE, "Decoding failed");
+            }
+            if (refrec) {
+                reflen = bulk_parse_label(refrec, job->r, &ref, &refcap);
+                if (reflen != len
+                        || memcmp(ref, label, len * sizeof label[0]) != 0) {
+                    errx(EXIT_FAILURE, "Result doesn't match reference data");
+                }
+            }
+            /* "-9223372036854775808 " takes 21 bytes */
+            out = bulk_reserve(job, 21 * len + 1);
+            for (size_t k = 0; k < len; k++) {
+                char digits[20], *d = digits + sizeof digits;
+                uint64_t v = label[k] < 0 ?
+                    -(uint64_t)label[k] : (uint64_t)label[k];
+                if (k) {
+                    *out++ = ' ';
+                }
+                if (label[k] < 0) {
+                    *out++ = '-';
+                }
+                do {
+                    *--d = '0' + v % 10;
+                    v /= 10;
+                } while (v);
+                memcpy(out, d, digits + sizeof digits - d);
+                out += digits + sizeof digits - d;
+            }
+            *out++ = '\n';
+            job->outsize = out - job->out;
+        }
+        job->ncomps += len;
     }
+
+    free(label);
+    free(ref);
+    return NULL;
 }
 
-static void decoding_benchmark(int n, const struct elabel *el,
-    ordpath_codec_t *codec)
+static void bulk_main(ordpath_codec_t *codec, const struct range *r,
+    int encode, const char *refdata, int nthreads)
 {
-    static struct label t;
-    int i;
-    for (i=0; i<n; i++) {
-        ordpath_decode(codec, ELABEL_BUF(el), el->bitlen, t.data, &t.len);
+    struct bulkfile in, ref;
+    struct bulkjob jobs[BULK_THREADS_MAX];
+    struct timespec ts[2];
+    size_t chunk, pos = 0, outsize = 0, ncomps = 0;
+    double t;
 
-        BENCHMARK_LOOP_DO_NOT_OPTIMIZE();
+    clock_gettime(CLOCK_MONOTONIC, &ts[0]);
+
+    bulk_map(&in, stdin, "input");
+    if (encode) {
+        bulk_split_labels(&in);
+    } else {
+        bulk_split_elabels(&in, "input");
+    }
+
+    if (refdata) {
+        FILE *file = fopen(refdata, "rb");
+        if (!file) {
+            err(EXIT_FAILURE, "Unable to open \"%s\" for reading", refdata);
+        }
+        bulk_map(&ref, file, refdata);
+        fclose(file);
+        if (encode) {
+            bulk_split_elabels(&ref, refdata);
+        } else {
+            bulk_split_labels(&ref);
+        }
+        if (ref.n != in.n) {
+            errx(EXIT_FAILURE, "Result doesn't match reference data "
+                "(%zu labels, %zu expected)", in.n, ref.n);
+        }
+    }
+
+    if (nthreads <= 0) {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = ncpu > 0 ? (int)ncpu : 1;
+    }
+    nthreads = nthreads < BULK_THREADS_MAX ? nthreads : BULK_THREADS_MAX;
+    chunk = (in.n + nthreads - 1) / nthreads;
+
+    for (int i = 0; i < nthreads; i++) {
+        struct bulkjob *job = jobs + i;
+        memset(job, 0, sizeof *job);
+        job->codec = codec;
+        job->r = r;
+        job->encode = encode;
+        job->recs = in.recs + pos;
+        job->refrecs = refdata ? ref.recs + pos : NULL;
+        job->n = chunk < in.n - pos ? chunk : in.n - pos;
+        pos += job->n;
+        if (i && pthread_create(&job->thread, NULL, bulk_worker, job)) {
+            errx(EXIT_FAILURE, "Unable to start a thread");
+        }
+    }
+    bulk_worker(jobs);
+    for (int i = 1; i < nthreads; i++) {
+        pthread_join(jobs[i].thread, NULL);
+    }
+
+    for (int i = 0; i < nthreads; i++) {
+        if (!refdata && jobs[i].outsize != fwrite(jobs[i].out,
+                    1, jobs[i].outsize, stdout)) {
+            err(EXIT_FAILURE, "Write failed");
+        }
+        outsize += jobs[i].outsize;
+        ncomps += jobs[i].ncomps;
+        free(jobs[i].out);
+    }
+    if (!refdata && fflush(stdout) != 0) {
+        err(EXIT_FAILURE, "Write failed");
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &ts[1]);
+    t = TS2D(ts[1]) - TS2D(ts[0]);
+    fprintf(stderr, "%s %zu labels (%zu components) in %.3lf s, "
+        "%d threads: %.0lf labels/s, %.1lf MB/s in, %.1lf MB/s out\n",
+        encode ? "encoded" : "decoded", in.n, ncomps, t, nthreads,
+        in.n / t, in.size / t / 1e6, outsize / t / 1e6);
+
+    bulk_unmap(&in);
+    if (refdata) {
+        bulk_unmap(&ref);
     }
 }
 
@@ -194,7 +2597,24 @@ int main(int argc, char **argv)
         OPT_DECODE,
         OPT_BENCHMARK,
         OPT_SETUP,
-        OPT_REFDATA
+        OPT_REFDATA,
+        OPT_BATCH,
+        OPT_HASH,
+        OPT_JOIN,
+        OPT_LEVELS,
+        OPT_UNALIGNED,
+        OPT_EXACT,
+        OPT_COLUMNS,
+        OPT_TRANSCODE,
+        OPT_SUBTREE,
+        OPT_LCA,
+        OPT_BULK,
+        OPT_THREADS,
+        OPT_DELIMITED,
+        OPT_FAMILY,
+        OPT_PARALLEL,
+        OPT_TRIE,
+        OPT_CACHE
     };
 
     static const struct option options[] = {
@@ -204,12 +2624,42 @@ int main(int argc, char **argv)
         {"benchmark", 0, NULL, OPT_BENCHMARK},
         {"setup", 1, NULL, OPT_SETUP},
         {"reference-data", 1, NULL, OPT_REFDATA},
+        {"batch", 0, NULL, OPT_BATCH},
+        {"hash", 0, NULL, OPT_HASH},
+        {"join", 0, NULL, OPT_JOIN},
+        {"levels", 0, NULL, OPT_LEVELS},
+        {"unaligned", 0, NULL, OPT_UNALIGNED},
+        {"exact", 0, NULL, OPT_EXACT},
+        {"columns", 0, NULL, OPT_COLUMNS},
+        {"transcode", 0, NULL, OPT_TRANSCODE},
+        {"subtree", 0, NULL, OPT_SUBTREE},
+        {"lca", 0, NULL, OPT_LCA},
+        {"bulk", 0, NULL, OPT_BULK},
+        {"threads", 1, NULL, OPT_THREADS},
+        {"delimited", 0, NULL, OPT_DELIMITED},
+        {"family", 0, NULL, OPT_FAMILY},
+        {"parallel", 0, NULL, OPT_PARALLEL},
+        {"trie", 0, NULL, OPT_TRIE},
+        {"cache", 0, NULL, OPT_CACHE},
         {NULL, 0, NULL, 0}
     };
 
     int benchmark = 0;
+    int batch = 0;
+    int hash = 0;
+    int levels = 0;
+    int unaligned = 0;
+    int exact = 0;
+    int transcode = 0;
+    int delimited = 0;
+    int bulk = 0;
+    int threads = 0;
     const char *refdata = NULL;
-    enum {MODE_ENCODE = 1, MODE_DECODE} mode = 0;
+    enum {
+        MODE_ENCODE = 1, MODE_DECODE, MODE_JOIN, MODE_COLUMNS, MODE_SUBTREE,
+        MODE_LCA, MODE_FAMILY, MODE_PARALLEL, MODE_TRIE,
+        MODE_CACHE
+    } mode = 0;
     ordpath_codec_t *codec = NULL;
     const char *setupname = "<builtin-setup>";
     char setup[SETUP_LEN_MAX] = "\
@@ -234,6 +2684,7 @@ int main(int argc, char **argv)
     static struct label label;
     static struct elabel elabel;
     char errorbuf[96];
+    size_t maxlen;
     int opt;
 
     while (-1 != (opt = getopt_long(argc, argv, "", options, NULL))) {
@@ -262,12 +2713,67 @@ int main(int argc, char **argv)
         case OPT_REFDATA:
             refdata = optarg;
             break;
+        case OPT_BATCH:
+            batch = 1;
+            break;
+        case OPT_HASH:
+            hash = 1;
+            break;
+        case OPT_JOIN:
+            mode = MODE_JOIN;
+            break;
+        case OPT_LEVELS:
+            levels = 1;
+            break;
+        case OPT_UNALIGNED:
+            unaligned = 1;
+            break;
+        case OPT_EXACT:
+            exact = 1;
+            break;
+        case OPT_COLUMNS:
+            mode = MODE_COLUMNS;
+            break;
+        case OPT_TRANSCODE:
+            transcode = 1;
+            break;
+        case OPT_FAMILY:
+            mode = MODE_FAMILY;
+            break;
+        case OPT_PARALLEL:
+            mode = MODE_PARALLEL;
+            break;
+        case OPT_TRIE:
+            mode = MODE_TRIE;
+            break;
+        case OPT_CACHE:
+            mode = MODE_CACHE;
+            break;
+        case OPT_DELIMITED:
+            delimited = 1;
+            break;
+        case OPT_SUBTREE:
+            mode = MODE_SUBTREE;
+            break;
+        case OPT_LCA:
+            mode = MODE_LCA;
+            break;
+        case OPT_BULK:
+            bulk = 1;
+            break;
+        case OPT_THREADS:
+            threads = atoi(optarg);
+            break;
         }
     }
     argc -= optind;
     argv += optind;
 
-    if (mode != MODE_ENCODE && mode != MODE_DECODE) {
+    if (mode != MODE_ENCODE && mode != MODE_DECODE && mode != MODE_JOIN
+            && mode != MODE_COLUMNS && mode != MODE_SUBTREE
+            && mode != MODE_LCA && mode != MODE_FAMILY
+            && mode != MODE_PARALLEL && mode != MODE_TRIE
+            && mode != MODE_CACHE) {
         errx(EXIT_FAILURE,
             "Please select mode (pass either --encode or --decode option)");
     }
@@ -296,10 +2802,69 @@ int main(int argc, char **argv)
             setupname, errorbuf);
     }
 
+    if (mode == MODE_JOIN) {
+        join_test(codec, benchmark);
+        ordpath_destroy(codec);
+        return EXIT_SUCCESS;
+    }
+
+    if (bulk && (mode == MODE_ENCODE || mode == MODE_DECODE)) {
+        bulk_main(codec, &r, mode == MODE_ENCODE, refdata, threads);
+        ordpath_destroy(codec);
+        return EXIT_SUCCESS;
+    }
+
+    if (mode == MODE_PARALLEL) {
+        parallel_test(codec, &r, threads, benchmark);
+        ordpath_destroy(codec);
+        return EXIT_SUCCESS;
+    }
+
+    if (mode == MODE_CACHE) {
+        cache_test(codec, threads, benchmark);
+        ordpath_destroy(codec);
+        return EXIT_SUCCESS;
+    }
+
+    if (mode == MODE_TRIE) {
+        trie_test(codec, &r, benchmark);
+        ordpath_destroy(codec);
+        return EXIT_SUCCESS;
+    }
+
+    if (mode == MODE_FAMILY) {
+        if (argc) {
+            read_label(&label, stdin, &r);
+        }
+        family_test(codec, setup, &r, argc ? &label : NULL, benchmark);
+        ordpath_destroy(codec);
+        return EXIT_SUCCESS;
+    }
+
+    if (mode == MODE_LCA) {
+        lca_test(codec, benchmark);
+        ordpath_destroy(codec);
+        return EXIT_SUCCESS;
+    }
+
+    if (mode == MODE_SUBTREE) {
+        subtree_test(codec);
+        ordpath_destroy(codec);
+        return EXIT_SUCCESS;
+    }
+
+    if (mode == MODE_COLUMNS) {
+        columns_test(codec, &r, benchmark);
+        ordpath_destroy(codec);
+        return EXIT_SUCCESS;
+    }
+
     if (mode == MODE_ENCODE) {
         read_label(&label, stdin, &r);
-        if (ORDPATH_SUCCESS !=
-                (status = ordpath_encode(
+        if (ORDPATH_SUCCESS != (status = exact ?
+                    encode_exact(codec, &label, &elabel) : unaligned ?
+                    encode_unaligned(codec, &label, &elabel) :
+                    ordpath_encode(
                         codec,
                         label.data, label.len,
                         ELABEL_BUF(&elabel), &elabel.bitlen))) {
@@ -309,8 +2874,10 @@ int main(int argc, char **argv)
         }
     } else {
         read_elabel(&elabel, stdin);
-        if (ORDPATH_SUCCESS !=
-                (status = ordpath_decode(
+        if (ORDPATH_SUCCESS != (status = batch ?
+                    decode_batch(codec, &elabel, &label) : unaligned ?
+                    decode_unaligned(codec, &elabel, &label) :
+                    ordpath_decode(
                         codec,
                         ELABEL_BUF(&elabel), elabel.bitlen,
                         label.data, &label.len))) {
@@ -318,11 +2885,31 @@ int main(int argc, char **argv)
             ordpath_strerror(status, errorbuf, sizeof errorbuf);
             errx(EXIT_FAILURE, "Decoding failed: %s", errorbuf);
         }
+        ordpath_decoded_maxlen(codec, elabel.bitlen, &maxlen);
+        if (label.len > maxlen) {
+            errx(EXIT_FAILURE, "Size query doesn't match decoded label");
+        }
+    }
+
+    if (hash) {
+        check_hash(&elabel);
+    }
+
+    if (levels) {
+        check_levels(codec, &elabel, &label);
+    }
+
+    if (transcode) {
+        check_transcode(codec, &elabel, &label);
+    }
+
+    if (delimited) {
+        check_delimited(codec, &elabel, &label);
     }
 
     if (benchmark) {
-        double times[4];
-        for (int i = 1; i<4; i++) {
+        double times[10];
+        for (int i = 1; i<10; i++) {
             const char *title;
             struct timespec ts_before = {0}, ts_after = {0};
             clock_gettime(CLOCK_MONOTONIC, &ts_before);
@@ -339,10 +2926,34 @@ int main(int argc, char **argv)
                 title = "ordpath_decode";
                 decoding_benchmark(BENCHMARK_LOOP_COUNT, &elabel, codec);
                 break;
+            case 4:
+                title = "ordpath_decode_batch";
+                decoding_batch_benchmark(BENCHMARK_LOOP_COUNT, &elabel, codec);
+                break;
+            case 5:
+                title = "ordpath_depth";
+                depth_benchmark(BENCHMARK_LOOP_COUNT, &elabel, codec);
+                break;
+            case 6:
+                title = "ordpath_transcode";
+                transcoding_benchmark(BENCHMARK_LOOP_COUNT, &elabel, codec);
+                break;
+            case 7:
+                title = "decode + encode";
+                decode_encode_benchmark(BENCHMARK_LOOP_COUNT, &elabel, codec);
+                break;
+            case 8:
+                title = "decode_delimited";
+                delimited_benchmark(BENCHMARK_LOOP_COUNT, &label, 0);
+                break;
+            case 9:
+                title = "skip_delimited";
+                delimited_benchmark(BENCHMARK_LOOP_COUNT, &label, 1);
+                break;
             }
             clock_gettime(CLOCK_MONOTONIC, &ts_after);
             times[i] = TS2D(ts_after) - TS2D(ts_before);
-            printf("%-14s    %8.3lf    %8.1lf\n",
+            printf("%-20s    %8.3lf    %8.1lf\n",
                 title, times[i], times[i]/times[1]*16.0);
         }
     } else if (refdata) {
@@ -17,6 +17,9 @@
 #                            list; non-positive clamp value K is
 #                            interpreted as a request to discard first
 #                            |K| elements from the list
+#     --bulk=<integer>       generate several labels, one label per line
+#                            (components separated by spaces); lengths
+#                            are random, up to --length
 
 # REFENCODE.py
 #
@@ -26,6 +29,8 @@
 #
 #     --setup=<filename>     read ORDPATH codec setup from the file
 #                            specified
+#     --bulk                 read several labels, one label per line;
+#                            write encoded labels one after another
 
 import sys, os, math, re, random, getopt
 
@@ -84,9 +89,10 @@ def randlabelMain(opts = []):
     length = 10
     setupstr = None 
     clamp = 0
+    bulk = None
 
     optlist, args = getopt.getopt(
-            opts, 'l:', ['length=', 'setup=', 'clamp='])
+            opts, 'l:', ['length=', 'setup=', 'clamp=', 'bulk='])
 
     for o, a in optlist:
         if o in ['-l', '--length']: length = int(a)
@@ -94,13 +100,19 @@ def randlabelMain(opts = []):
             with open(a) as f:
                 setupstr = f.read()
         elif o in ['--clamp']: clamp = int(a)
+        elif o in ['--bulk']: bulk = int(a)
 
     input, output = inputOutput(args)
 
     setup = parseSetup(setupstr)
     clamped = setup[-clamp : ] if clamp <= 0 else setup[ : clamp]
-    data = randLabel(clamped, length)
-    output.write('\n'.join(map(str, data)) + '\n')
+    if bulk is None:
+        data = randLabel(clamped, length)
+        output.write('\n'.join(map(str, data)) + '\n')
+    else:
+        for i in xrange(bulk):
+            data = randLabel(clamped, random.randint(0, length))
+            output.write(' '.join(map(str, data)) + '\n')
 
 def refEncode(setup, label):
     return ''.join([(lambda (b, e, pfx, width):
@@ -108,25 +120,33 @@ def refEncode(setup, label):
                         next((i for i in setup if c >= i[0] and c < i[1]))) 
             for c in label])
 
+def writeEncoded(output, elabel):
+    output.write("%-15d\n" % len(elabel))
+    t = elabel + '0' * 7
+    encoded = ''.join((chr(int(t[i:i+8], 2)) for i in range(0, len(elabel),8)))
+    output.write(encoded)
+
 def refencodeMain(opts = []):
     setupstr = None
+    bulk = False
 
-    optlist, args = getopt.getopt(opts, '', ['setup='])
+    optlist, args = getopt.getopt(opts, '', ['setup=', 'bulk'])
 
     for o, a in optlist:
         if o in ['--setup']:
             with open(a) as f:
                 setupstr = f.read()
+        elif o in ['--bulk']: bulk = True
 
     input, output = inputOutput(args)
 
     setup = parseSetup(setupstr)
-    label = map(int, input.read().split())
-    elabel = refEncode(setup, label)
-    output.write("%-15d\n" % len(elabel))
-    t = elabel + '0' * 7
-    encoded = ''.join((chr(int(t[i:i+8], 2)) for i in range(0, len(elabel),8)))
-    output.write(encoded)
+    if bulk:
+        for line in input:
+            writeEncoded(output, refEncode(setup, map(int, line.split())))
+    else:
+        label = map(int, input.read().split())
+        writeEncoded(output, refEncode(setup, label))
 
 if __name__ == '__main__':
     {